@@ -4,9 +4,11 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/select.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -31,6 +33,8 @@ static double first_time, last_time;
 
 /* Implement buffered I/O using variant of RIO package from CS:APP
  * Must create stack of buffers to handle I/O with nested source commands.
+ * Regular files are mapped into memory instead, and lines are handed out
+ * directly from the mapping without copying.
  */
 
 #define RIO_BUFSIZE 8192
@@ -40,6 +44,9 @@ typedef struct __rio {
     int count;             /* Unread bytes in internal buffer */
     char *bufptr;          /* Next unread byte in internal buffer */
     char buf[RIO_BUFSIZE]; /* Internal buffer */
+    char *map;             /* Mapped file contents, or NULL */
+    size_t map_size;       /* Size of mapping */
+    size_t map_pos;        /* Offset of next unread byte in mapping */
     struct __rio *prev;    /* Next element in stack */
 } rio_t;
 
@@ -65,6 +72,24 @@ static bool has_infile = false;
 static cmd_func_t quit_helpers[MAXQUIT];
 static int quit_helper_cnt = 0;
 
+/* Open-addressing hash tables mapping command and parameter names to their
+ * list elements, so that dispatch does not walk the sorted lists.
+ * Tables are kept at most half full to bound the probe length.
+ */
+#define HASH_BITS 8
+#define HASH_SIZE (1 << HASH_BITS)
+#define HASH_MAX_ENTRIES (HASH_SIZE / 2)
+
+typedef struct {
+    const char *name;
+    void *elem;
+} hash_slot_t;
+
+static hash_slot_t cmd_table[HASH_SIZE];
+static hash_slot_t param_table[HASH_SIZE];
+static int cmd_table_cnt = 0;
+static int param_table_cnt = 0;
+
 static void init_in();
 
 static bool push_file(char *fname);
@@ -72,6 +97,60 @@ static void pop_file();
 
 static bool interpret_cmda(int argc, char *argv[]);
 
+/* 32-bit FNV-1a hash of a name */
+static uint32_t hash_name(const char *name)
+{
+    uint32_t h = 2166136261u;
+    while (*name) {
+        h ^= (uint8_t) *name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Insert or replace the element stored under name.
+ * Return false if the table is already full.
+ */
+static bool hash_insert(hash_slot_t *table,
+                        int *cntp,
+                        const char *name,
+                        void *elem)
+{
+    uint32_t i = hash_name(name) & (HASH_SIZE - 1);
+    while (table[i].name) {
+        if (strcmp(table[i].name, name) == 0) {
+            table[i].elem = elem;
+            return true;
+        }
+        i = (i + 1) & (HASH_SIZE - 1);
+    }
+
+    if (*cntp >= HASH_MAX_ENTRIES)
+        return false;
+    table[i].name = name;
+    table[i].elem = elem;
+    (*cntp)++;
+    return true;
+}
+
+/* Return element stored under name, or NULL when not found */
+static void *hash_lookup(const hash_slot_t *table, const char *name)
+{
+    uint32_t i = hash_name(name) & (HASH_SIZE - 1);
+    while (table[i].name) {
+        if (strcmp(table[i].name, name) == 0)
+            return table[i].elem;
+        i = (i + 1) & (HASH_SIZE - 1);
+    }
+    return NULL;
+}
+
+static void hash_clear(hash_slot_t *table, int *cntp)
+{
+    memset(table, 0, HASH_SIZE * sizeof(hash_slot_t));
+    *cntp = 0;
+}
+
 /* Add a new command */
 void add_cmd(char *name, cmd_func_t operation, char *summary, char *param)
 {
@@ -89,6 +168,9 @@ void add_cmd(char *name, cmd_func_t operation, char *summary, char *param)
     cmd->param = param;
     cmd->next = next_cmd;
     *last_loc = cmd;
+
+    if (!hash_insert(cmd_table, &cmd_table_cnt, name, cmd))
+        report_event(MSG_FATAL, "Exceeded limit on commands");
 }
 
 /* Add a new parameter */
@@ -109,26 +191,57 @@ void add_param(char *name, int *valp, char *summary, setter_func_t setter)
     param->setter = setter;
     param->next = next_param;
     *last_loc = param;
+
+    if (!hash_insert(param_table, &param_table_cnt, name, param))
+        report_event(MSG_FATAL, "Exceeded limit on parameters");
 }
 
-/* Parse a string into a command line */
-static char **parse_args(char *line, int *argcp)
+/* Scratch storage reused by parse_args across command lines.
+ * A line of len characters holds at most (len + 1) / 2 arguments.
+ */
+static char *arg_buf = NULL;
+static char **arg_vec = NULL;
+static size_t arg_buf_size = 0;
+
+static void free_args()
 {
-    /* Must first determine how many arguments there are.
-     * Replace all white space with null characters
-     */
-    size_t len = strlen(line);
+    if (!arg_buf)
+        return;
+    free_block(arg_buf, arg_buf_size);
+    free_array(arg_vec, arg_buf_size / 2 + 1, sizeof(char *));
+    arg_buf = NULL;
+    arg_vec = NULL;
+    arg_buf_size = 0;
+}
 
-    /* First copy into buffer with each substring null-terminated */
-    char *buf = malloc_or_fail(len + 1, "parse_args");
-    buf[len] = '\0';
+/* Parse a string into a command line.
+ * The returned vector and strings stay valid until the next call.
+ */
+static char **parse_args(const char *line, size_t len, int *argcp)
+{
+    /* Grow scratch storage geometrically, so allocation is amortized away */
+    if (len + 1 > arg_buf_size) {
+        size_t size = arg_buf_size ? arg_buf_size : 128;
+        while (size < len + 1)
+            size *= 2;
+        free_args();
+        arg_buf = malloc_or_fail(size, "parse_args");
+        arg_vec = calloc_or_fail(size / 2 + 1, sizeof(char *), "parse_args");
+        arg_buf_size = size;
+    }
 
-    char *src = line;
-    char *dst = buf;
+    /* Copy into buffer with each substring null-terminated, recording the
+     * start of every substring as we go.
+     */
+    const char *src = line;
+    const char *end = line + len;
+    char *dst = arg_buf;
     bool skipping = true;
-    int c;
     int argc = 0;
-    while ((c = *src++) != '\0') {
+    while (src < end) {
+        int c = (unsigned char) *src++;
+        if (c == '\0')
+            break;
         if (isspace(c)) {
             if (!skipping) {
                 /* Hit end of word */
@@ -138,26 +251,17 @@ static char **parse_args(char *line, int *argcp)
         } else {
             if (skipping) {
                 /* Hit start of new word */
-                argc++;
+                arg_vec[argc++] = dst;
                 skipping = false;
             }
             *dst++ = c;
         }
     }
     /* Let the last substring is null-terminated */
-    *dst++ = '\0';
-
-    /* Now assemble into array of strings */
-    char **argv = calloc_or_fail(argc, sizeof(char *), "parse_args");
-    src = buf;
-    for (int i = 0; i < argc; i++) {
-        argv[i] = strsave_or_fail(src, "parse_args");
-        src += strlen(argv[i]) + 1;
-    }
+    *dst = '\0';
 
-    free_block(buf, len + 1);
     *argcp = argc;
-    return argv;
+    return arg_vec;
 }
 
 /* Handles forced console termination for record_error and do_quit */
@@ -177,6 +281,10 @@ static bool force_quit(int argc, char *argv[])
         p = p->next;
         free_block(ele, sizeof(param_element_t));
     }
+    cmd_list = NULL;
+    param_list = NULL;
+    hash_clear(cmd_table, &cmd_table_cnt);
+    hash_clear(param_table, &param_table_cnt);
 
     while (buf_stack)
         pop_file();
@@ -200,16 +308,10 @@ static void record_error()
     }
 }
 
-/* Execute a command that has already been split into arguments */
-static bool interpret_cmda(int argc, char *argv[])
+/* Execute an already resolved command.  next_cmd == NULL for unknown ones */
+static bool dispatch_cmd(cmd_element_t *next_cmd, int argc, char *argv[])
 {
-    if (argc == 0)
-        return true;
-    /* Try to find matching command */
-    cmd_element_t *next_cmd = cmd_list;
     bool ok = true;
-    while (next_cmd && strcmp(argv[0], next_cmd->name) != 0)
-        next_cmd = next_cmd->next;
     if (next_cmd) {
         ok = next_cmd->operation(argc, argv);
         if (!ok)
@@ -223,20 +325,24 @@ static bool interpret_cmda(int argc, char *argv[])
     return ok;
 }
 
-/* Execute a command from a command line */
-static bool interpret_cmd(char *cmdline)
+/* Execute a command that has already been split into arguments */
+static bool interpret_cmda(int argc, char *argv[])
+{
+    if (argc == 0)
+        return true;
+    /* Try to find matching command */
+    return dispatch_cmd(hash_lookup(cmd_table, argv[0]), argc, argv);
+}
+
+/* Execute a command from a command line of len characters */
+static bool interpret_cmd(const char *cmdline, size_t len)
 {
     if (quit_flag)
         return false;
 
     int argc;
-    char **argv = parse_args(cmdline, &argc);
-    bool ok = interpret_cmda(argc, argv);
-    for (int i = 0; i < argc; i++)
-        free_string(argv[i]);
-    free_array(argv, argc, sizeof(char *));
-
-    return ok;
+    char **argv = parse_args(cmdline, len, &argc);
+    return interpret_cmda(argc, argv);
 }
 
 /* Set function to be executed as part of program exit */
@@ -321,7 +427,6 @@ static bool do_option(int argc, char *argv[])
     for (int i = 1; i < argc; i++) {
         char *name = argv[i];
         int value = 0;
-        bool found = false;
         /* Get value from next argument */
         if (i + 1 >= argc) {
             report(1, "No value given for parameter %s", name);
@@ -330,23 +435,17 @@ static bool do_option(int argc, char *argv[])
             report(1, "Cannot parse '%s' as integer", argv[i]);
             return false;
         }
-        /* Find parameter in list */
-        param_element_t *plist = param_list;
-        while (!found && plist) {
-            if (strcmp(plist->name, name) == 0) {
-                int oldval = *plist->valp;
-                *plist->valp = value;
-                if (plist->setter)
-                    plist->setter(oldval);
-                found = true;
-            } else
-                plist = plist->next;
-        }
+        /* Find parameter by name */
+        param_element_t *plist = hash_lookup(param_table, name);
         /* Didn't find parameter */
-        if (!found) {
+        if (!plist) {
             report(1, "Unknown parameter '%s'", name);
             return false;
         }
+        int oldval = *plist->valp;
+        *plist->valp = value;
+        if (plist->setter)
+            plist->setter(oldval);
     }
 
     return true;
@@ -430,6 +529,8 @@ void init_cmd()
 {
     cmd_list = NULL;
     param_list = NULL;
+    hash_clear(cmd_table, &cmd_table_cnt);
+    hash_clear(param_table, &param_table_cnt);
     err_cnt = 0;
     quit_flag = false;
 
@@ -472,9 +573,28 @@ static bool push_file(char *fname)
     rnew->fd = fd;
     rnew->count = 0;
     rnew->bufptr = rnew->buf;
+    rnew->map = NULL;
+    rnew->map_size = 0;
+    rnew->map_pos = 0;
     rnew->prev = buf_stack;
     buf_stack = rnew;
 
+    /* Map non-empty regular files.  Anything else, or a failed mapping,
+     * falls back to buffered reads.
+     */
+    struct stat st;
+    if (fname && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+#ifdef POSIX_MADV_SEQUENTIAL
+            posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+#endif
+            rnew->map = map;
+            rnew->map_size = st.st_size;
+        }
+    }
+
     return true;
 }
 
@@ -484,6 +604,8 @@ static void pop_file()
     if (buf_stack) {
         rio_t *rsave = buf_stack;
         buf_stack = rsave->prev;
+        if (rsave->map)
+            munmap(rsave->map, rsave->map_size);
         close(rsave->fd);
         free_block(rsave, sizeof(rio_t));
     }
@@ -495,18 +617,48 @@ static void init_in()
     buf_stack = NULL;
 }
 
-/* Read command from input file.
- * When hit EOF, close that file and return NULL
- */
-static char *readline()
+static void echo_line(const char *line, size_t len)
 {
-    char c;
-    char *lptr = linebuf;
+    if (!echo)
+        return;
+    bool newline = len > 0 && line[len - 1] == '\n';
+    report_noreturn(1, "%s%.*s%s", prompt, (int) len, line,
+                    newline ? "" : "\n");
+}
 
+/* Read command from input file, storing its length at lenp.
+ * The returned line is not null-terminated, and stays valid until the next
+ * call.  When hit EOF, close that file and return NULL
+ */
+static char *readline(size_t *lenp)
+{
     if (!buf_stack)
         return NULL;
 
-    for (int cnt = 0; cnt < RIO_BUFSIZE - 2; cnt++) {
+    if (buf_stack->map) {
+        rio_t *rp = buf_stack;
+        /* The file is popped only once exhausted, since the previous line
+         * may still point into the mapping.
+         */
+        if (rp->map_pos >= rp->map_size) {
+            pop_file();
+            return NULL;
+        }
+
+        char *line = rp->map + rp->map_pos;
+        size_t avail = rp->map_size - rp->map_pos;
+        const char *nl = memchr(line, '\n', avail);
+        size_t len = nl ? (size_t) (nl - line) + 1 : avail;
+        rp->map_pos += len;
+
+        echo_line(line, len);
+        *lenp = len;
+        return line;
+    }
+
+    size_t len = 0;
+    bool newline = false;
+    while (!newline && len < RIO_BUFSIZE - 2) {
         if (buf_stack->count <= 0) {
             /* Need to read from input file */
             buf_stack->count = read(buf_stack->fd, buf_stack->buf, RIO_BUFSIZE);
@@ -514,40 +666,36 @@ static char *readline()
             if (buf_stack->count <= 0) {
                 /* Encountered EOF */
                 pop_file();
-                if (cnt > 0) {
-                    /* Last line of file did not terminate with newline. */
-                    /*  Terminate line & return it */
-                    *lptr++ = '\n';
-                    *lptr++ = '\0';
-                    if (echo) {
-                        report_noreturn(1, prompt);
-                        report_noreturn(1, linebuf);
-                    }
-                    return linebuf;
-                }
-                return NULL;
+                if (len == 0)
+                    return NULL;
+                /* Last line of file did not terminate with newline. */
+                break;
             }
         }
 
-        /* Have text in buffer */
-        c = *buf_stack->bufptr++;
-        *lptr++ = c;
-        buf_stack->count--;
-        if (c == '\n')
-            break;
-    }
-
-    if (c != '\n') {
-        /* Hit buffer limit.  Artificially terminate line */
-        *lptr++ = '\n';
+        /* Have text in buffer.  Copy up to and including the next newline */
+        size_t n = buf_stack->count;
+        if (n > RIO_BUFSIZE - 2 - len)
+            n = RIO_BUFSIZE - 2 - len;
+        const char *nl = memchr(buf_stack->bufptr, '\n', n);
+        if (nl) {
+            n = nl - buf_stack->bufptr + 1;
+            newline = true;
+        }
+        memcpy(linebuf + len, buf_stack->bufptr, n);
+        buf_stack->bufptr += n;
+        buf_stack->count -= n;
+        len += n;
     }
-    *lptr++ = '\0';
 
-    if (echo) {
-        report_noreturn(1, prompt);
-        report_noreturn(1, linebuf);
+    if (!newline) {
+        /* Hit EOF or buffer limit.  Artificially terminate line */
+        linebuf[len++] = '\n';
     }
+    linebuf[len] = '\0';
 
+    echo_line(linebuf, len);
+    *lenp = len;
     return linebuf;
 }
 
@@ -593,15 +741,17 @@ static int cmd_select(int nfds,
             FD_SET(web_fd, readfds);
 
         if (infd == STDIN_FILENO && prompt_flag) {
+            report_flush();
             char *cmdline = linenoise(prompt);
             if (cmdline)
-                interpret_cmd(cmdline);
+                interpret_cmd(cmdline, strlen(cmdline));
             fflush(stdout);
             prompt_flag = true;
         } else if (infd != STDIN_FILENO) {
-            char *cmdline = readline();
+            size_t len;
+            char *cmdline = readline(&len);
             if (cmdline)
-                interpret_cmd(cmdline);
+                interpret_cmd(cmdline, len);
         }
     }
     return 0;
@@ -612,7 +762,9 @@ bool finish_cmd()
     bool ok = true;
     if (!quit_flag)
         ok = ok && do_quit(0, NULL);
+    free_args();
     has_infile = false;
+    report_flush();
     return ok && err_cnt == 0;
 }
 
@@ -666,14 +818,16 @@ bool run_console(char *infile_name)
 
     if (!has_infile) {
         char *cmdline;
+        report_flush();
         while (use_linenoise && (cmdline = linenoise(prompt))) {
-            interpret_cmd(cmdline);
+            interpret_cmd(cmdline, strlen(cmdline));
             line_history_add(cmdline);       /* Add to the history. */
             line_history_save(HISTORY_FILE); /* Save the history on disk. */
             line_free(cmdline);
             while (buf_stack && buf_stack->fd != STDIN_FILENO)
                 cmd_select(0, NULL, NULL, NULL, NULL);
             has_infile = false;
+            report_flush();
         }
         if (!use_linenoise) {
             while (!cmd_done())
@@ -686,3 +840,305 @@ bool run_console(char *infile_name)
 
     return err_cnt == 0;
 }
+
+/* Compiled traces.
+ * A compiled trace is a header, followed by one record per non-empty command
+ * line, followed by the table of distinct strings appearing in the source.
+ * A record is the argument count and the string IDs of the arguments, the
+ * first one being the command name.  A string is its length and its bytes.
+ * All integers are 32-bit in host byte order.
+ */
+#define TRACE_MAGIC "QTBC"
+#define TRACE_VERSION 1
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t n_records;
+    uint32_t n_words; /* Number of 32-bit words in all records */
+    uint32_t n_strings;
+} trace_header_t;
+
+/* State used while compiling a trace */
+typedef struct {
+    char **strings;
+    uint32_t n_strings;
+    uint32_t strings_cap;
+    uint32_t *slots; /* String ID + 1, or 0 if empty */
+    uint32_t n_slots;
+    uint32_t *words;
+    uint32_t n_words;
+    uint32_t words_cap;
+    uint32_t n_records;
+} trace_builder_t;
+
+/* Resize block from old_bytes to new_bytes, preserving its contents */
+static void *grow_block(void *b, size_t old_bytes, size_t new_bytes)
+{
+    void *nb = malloc_or_fail(new_bytes, "grow_block");
+    if (b) {
+        memcpy(nb, b, old_bytes);
+        free_block(b, old_bytes);
+    }
+    return nb;
+}
+
+static void builder_push(trace_builder_t *tb, uint32_t word)
+{
+    if (tb->n_words == tb->words_cap) {
+        uint32_t cap = tb->words_cap ? tb->words_cap * 2 : 1024;
+        tb->words = grow_block(tb->words, tb->words_cap * sizeof(uint32_t),
+                               cap * sizeof(uint32_t));
+        tb->words_cap = cap;
+    }
+    tb->words[tb->n_words++] = word;
+}
+
+static void builder_rehash(trace_builder_t *tb, uint32_t n_slots)
+{
+    if (tb->slots)
+        free_array(tb->slots, tb->n_slots, sizeof(uint32_t));
+    tb->slots = calloc_or_fail(n_slots, sizeof(uint32_t), "builder_rehash");
+    tb->n_slots = n_slots;
+    for (uint32_t id = 0; id < tb->n_strings; id++) {
+        uint32_t i = hash_name(tb->strings[id]) & (n_slots - 1);
+        while (tb->slots[i])
+            i = (i + 1) & (n_slots - 1);
+        tb->slots[i] = id + 1;
+    }
+}
+
+/* Return ID of string s, adding it to the string table if needed */
+static uint32_t builder_intern(trace_builder_t *tb, const char *s)
+{
+    uint32_t i = hash_name(s) & (tb->n_slots - 1);
+    while (tb->slots[i]) {
+        uint32_t id = tb->slots[i] - 1;
+        if (strcmp(tb->strings[id], s) == 0)
+            return id;
+        i = (i + 1) & (tb->n_slots - 1);
+    }
+
+    if (tb->n_strings == tb->strings_cap) {
+        uint32_t cap = tb->strings_cap * 2;
+        tb->strings = grow_block(tb->strings, tb->strings_cap * sizeof(char *),
+                                 cap * sizeof(char *));
+        tb->strings_cap = cap;
+    }
+    uint32_t id = tb->n_strings++;
+    tb->strings[id] = strsave_or_fail(s, "builder_intern");
+    tb->slots[i] = id + 1;
+
+    /* Keep the table at most half full */
+    if (tb->n_strings * 2 >= tb->n_slots)
+        builder_rehash(tb, tb->n_slots * 2);
+    return id;
+}
+
+static bool builder_write(const trace_builder_t *tb, const char *outfile_name)
+{
+    FILE *out = fopen(outfile_name, "wb");
+    if (!out)
+        return false;
+
+    trace_header_t header = {
+        .magic = TRACE_MAGIC,
+        .version = TRACE_VERSION,
+        .n_records = tb->n_records,
+        .n_words = tb->n_words,
+        .n_strings = tb->n_strings,
+    };
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    if (ok && tb->n_words)
+        ok = fwrite(tb->words, sizeof(uint32_t), tb->n_words, out) ==
+             tb->n_words;
+    for (uint32_t id = 0; ok && id < tb->n_strings; id++) {
+        uint32_t len = strlen(tb->strings[id]);
+        ok = fwrite(&len, sizeof(len), 1, out) == 1 &&
+             fwrite(tb->strings[id], 1, len, out) == len;
+    }
+    return (fclose(out) == 0) && ok;
+}
+
+/* Compile commands in text file infile_name into outfile_name.
+ * Return true if successful.
+ */
+bool compile_trace(char *infile_name, char *outfile_name)
+{
+    if (!infile_name || !push_file(infile_name)) {
+        report(1, "ERROR: Could not open source file '%s'",
+               infile_name ? infile_name : "(stdin)");
+        return false;
+    }
+
+    trace_builder_t tb = {0};
+    tb.strings_cap = 64;
+    tb.strings = malloc_or_fail(tb.strings_cap * sizeof(char *),
+                                "compile_trace");
+    builder_rehash(&tb, 128);
+
+    /* Don't echo the source while compiling it */
+    int saved_echo = echo;
+    echo = 0;
+    rio_t *bottom = buf_stack->prev;
+    size_t len;
+    char *cmdline;
+    while (buf_stack != bottom && (cmdline = readline(&len))) {
+        int argc;
+        char **argv = parse_args(cmdline, len, &argc);
+        if (argc == 0)
+            continue;
+        builder_push(&tb, argc);
+        for (int i = 0; i < argc; i++)
+            builder_push(&tb, builder_intern(&tb, argv[i]));
+        tb.n_records++;
+    }
+    echo = saved_echo;
+    has_infile = false;
+
+    bool ok = builder_write(&tb, outfile_name);
+    if (!ok)
+        report(1, "ERROR: Could not write compiled trace '%s'", outfile_name);
+    else
+        report(1, "Compiled %u commands with %u distinct strings into '%s'",
+               tb.n_records, tb.n_strings, outfile_name);
+
+    for (uint32_t id = 0; id < tb.n_strings; id++)
+        free_string(tb.strings[id]);
+    free_block(tb.strings, tb.strings_cap * sizeof(char *));
+    free_array(tb.slots, tb.n_slots, sizeof(uint32_t));
+    if (tb.words)
+        free_block(tb.words, tb.words_cap * sizeof(uint32_t));
+    return ok;
+}
+
+/* Execute one decoded record of a compiled trace */
+static void run_record(cmd_element_t *cmd, int argc, char *argv[])
+{
+    if (echo) {
+        report_noreturn(1, "%s", prompt);
+        for (int i = 0; i < argc; i++)
+            report_noreturn(1, i ? " %s" : "%s", argv[i]);
+        report_noreturn(1, "\n");
+    }
+    dispatch_cmd(cmd, argc, argv);
+}
+
+/* Run commands from a trace compiled by compile_trace.
+ * Command names are resolved once per distinct string rather than once per
+ * command, and no line is ever tokenized.
+ */
+bool run_compiled(char *infile_name)
+{
+    int fd = open(infile_name, O_RDONLY);
+    if (fd < 0) {
+        report(1, "ERROR: Could not open compiled trace '%s'", infile_name);
+        return false;
+    }
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(trace_header_t))
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        report(1, "ERROR: Could not read compiled trace '%s'", infile_name);
+        return false;
+    }
+
+    const trace_header_t *header = map;
+    const char *end = (const char *) map + st.st_size;
+    const uint32_t *words = (const uint32_t *) (header + 1);
+    bool ok = memcmp(header->magic, TRACE_MAGIC, 4) == 0 &&
+              header->version == TRACE_VERSION &&
+              header->n_words <= (end - (const char *) words) / 4;
+    const char *p = ok ? (const char *) (words + header->n_words) : end;
+
+    /* Every string takes at least its length, and every record at least its
+     * argument count and command name, which bounds the counts in the header
+     * by the size of the file before anything is allocated from them.
+     */
+    ok = ok && header->n_strings <= (size_t) (end - p) / sizeof(uint32_t) &&
+         header->n_records <= header->n_words / 2;
+    if (!ok) {
+        report(1, "ERROR: '%s' is not a valid compiled trace", infile_name);
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    /* Decode string table into null-terminated strings */
+    size_t n_strings = header->n_strings;
+    size_t pool_size = (size_t) (end - p) + n_strings;
+    char **strings = calloc_or_fail(n_strings + 1, sizeof(char *),
+                                    "run_compiled");
+    char *pool = malloc_or_fail(pool_size + 1, "run_compiled");
+    char *dst = pool;
+    for (size_t id = 0; ok && id < n_strings; id++) {
+        uint32_t len;
+        if (end - p < (ptrdiff_t) sizeof(len)) {
+            ok = false;
+            break;
+        }
+        memcpy(&len, p, sizeof(len));
+        p += sizeof(len);
+        if (end - p < (ptrdiff_t) len) {
+            ok = false;
+            break;
+        }
+        memcpy(dst, p, len);
+        strings[id] = dst;
+        dst[len] = '\0';
+        dst += len + 1;
+        p += len;
+    }
+
+    /* Find largest argument count, checking every record is well formed, and
+     * resolve every command name
+     */
+    cmd_element_t **cmds = calloc_or_fail(n_strings + 1,
+                                          sizeof(cmd_element_t *),
+                                          "run_compiled");
+    uint32_t max_argc = 1;
+    for (uint32_t w = 0, r = 0; ok && r < header->n_records; r++) {
+        if (w >= header->n_words) {
+            ok = false;
+            break;
+        }
+        uint32_t argc = words[w++];
+        if (argc == 0 || argc > header->n_words - w) {
+            ok = false;
+            break;
+        }
+        for (uint32_t i = 0; i < argc; i++)
+            ok = ok && words[w + i] < n_strings;
+        if (ok && !cmds[words[w]])
+            cmds[words[w]] = hash_lookup(cmd_table, strings[words[w]]);
+        w += argc;
+        if (argc > max_argc)
+            max_argc = argc;
+    }
+
+    if (!ok) {
+        report(1, "ERROR: '%s' is not a valid compiled trace", infile_name);
+    } else {
+        char **argv = calloc_or_fail(max_argc, sizeof(char *), "run_compiled");
+        const uint32_t *w = words;
+        for (uint32_t r = 0; r < header->n_records && !quit_flag; r++) {
+            int argc = *w++;
+            cmd_element_t *cmd = cmds[*w];
+            for (int i = 0; i < argc; i++)
+                argv[i] = strings[*w++];
+            run_record(cmd, argc, argv);
+            /* Drain any file pushed by a 'source' command */
+            while (!cmd_done())
+                cmd_select(0, NULL, NULL, NULL, NULL);
+        }
+        free_array(argv, max_argc, sizeof(char *));
+    }
+
+    free_block(pool, pool_size + 1);
+    free_array(cmds, n_strings + 1, sizeof(cmd_element_t *));
+    free_array(strings, n_strings + 1, sizeof(char *));
+    munmap(map, st.st_size);
+    return ok && err_cnt == 0;
+}
@@ -68,6 +68,14 @@ bool finish_cmd();
  */
 bool run_console(char *infile_name);
 
+/* Compile commands in text file infile_name into a binary trace written to
+ * outfile_name.  Return true if successful.
+ */
+bool compile_trace(char *infile_name, char *outfile_name);
+
+/* Run commands from a binary trace produced by compile_trace */
+bool run_compiled(char *infile_name);
+
 /* Callback function to complete command by linenoise */
 void completion(const char *buf, line_completions_t *lc);
 
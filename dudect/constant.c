@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "constant.h"
@@ -36,8 +37,14 @@ static struct list_head *l = NULL;
 
 #define dut_free() ((void) (q_free(l)))
 
-static char random_string[N_MEASURES][8];
-static int random_string_iter = 0;
+/* Random strings for the current batch, one per measurement, each taking
+ * RANDOM_STRING_SIZE bytes.
+ */
+#define RANDOM_STRING_SIZE 8
+static char *random_string = NULL;
+static size_t random_string_cap = 0;
+static size_t random_string_count = 0;
+static size_t random_string_iter = 0;
 
 /* Implement the necessary queue interface to simulation */
 void init_dut(void)
@@ -45,44 +52,72 @@ void init_dut(void)
     l = NULL;
 }
 
+/* Release what the simulation has allocated */
+void release_dut(void)
+{
+    free(random_string);
+    random_string = NULL;
+    random_string_cap = random_string_count = 0;
+}
+
 static char *get_random_string(void)
 {
-    random_string_iter = (random_string_iter + 1) % N_MEASURES;
-    return random_string[random_string_iter];
+    random_string_iter = (random_string_iter + 1) % random_string_count;
+    return random_string + random_string_iter * RANDOM_STRING_SIZE;
 }
 
-void prepare_inputs(uint8_t *input_data, uint8_t *classes)
+/* Fill in the inputs and classes of a batch of n measurements */
+bool prepare_inputs(uint8_t *input_data, uint8_t *classes, size_t n)
 {
-    randombytes(input_data, N_MEASURES * CHUNK_SIZE);
-    for (size_t i = 0; i < N_MEASURES; i++) {
-        classes[i] = randombit();
+    if (n > random_string_cap) {
+        char *strings = realloc(random_string, n * RANDOM_STRING_SIZE);
+        if (!strings)
+            return false;
+        random_string = strings;
+        random_string_cap = n;
+    }
+    random_string_count = n;
+
+    random_fill(input_data, n * CHUNK_SIZE);
+    random_fill(classes, n);
+    for (size_t i = 0; i < n; i++) {
+        classes[i] &= 1;
         if (classes[i] == 0)
             memset(input_data + (size_t) i * CHUNK_SIZE, 0, CHUNK_SIZE);
     }
 
-    for (size_t i = 0; i < N_MEASURES; ++i) {
-        /* Generate random string */
-        randombytes((uint8_t *) random_string[i], 7);
-        random_string[i][7] = 0;
-    }
+    /* Generate random strings */
+    random_fill(random_string, n * RANDOM_STRING_SIZE);
+    for (size_t i = 0; i < n; ++i)
+        random_string[i * RANDOM_STRING_SIZE + RANDOM_STRING_SIZE - 1] = 0;
+    return true;
+}
+
+/* Length of the queue the operation is measured on for input i.  Removals
+ * and deletions need at least one element to work on.
+ */
+size_t dut_length(const uint8_t *input_data, size_t i, int mode)
+{
+    size_t len = *(uint16_t *) (input_data + i * CHUNK_SIZE) % MAX_QUEUE_LENGTH;
+    if (mode == DUT(remove_head) || mode == DUT(remove_tail) ||
+        mode == DUT(delete_mid))
+        len++;
+    return len;
 }
 
 bool measure(int64_t *before_ticks,
              int64_t *after_ticks,
              uint8_t *input_data,
-             int mode)
+             int mode,
+             size_t n)
 {
-    assert(mode == DUT(insert_head) || mode == DUT(insert_tail) ||
-           mode == DUT(remove_head) || mode == DUT(remove_tail));
-
     switch (mode) {
     case DUT(insert_head):
-        for (size_t i = 0; i < N_MEASURES; i++) {
+        for (size_t i = 0; i < n; i++) {
             char *s = get_random_string();
             dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * CHUNK_SIZE) % 10000);
+            dut_insert_head(get_random_string(),
+                            dut_length(input_data, i, mode));
             int before_size = q_size(l);
             before_ticks[i] = cpucycles();
             dut_insert_head(s, 1);
@@ -94,12 +129,11 @@ bool measure(int64_t *before_ticks,
         }
         break;
     case DUT(insert_tail):
-        for (size_t i = 0; i < N_MEASURES; i++) {
+        for (size_t i = 0; i < n; i++) {
             char *s = get_random_string();
             dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * CHUNK_SIZE) % 10000);
+            dut_insert_head(get_random_string(),
+                            dut_length(input_data, i, mode));
             int before_size = q_size(l);
             before_ticks[i] = cpucycles();
             dut_insert_tail(s, 1);
@@ -111,11 +145,10 @@ bool measure(int64_t *before_ticks,
         }
         break;
     case DUT(remove_head):
-        for (size_t i = 0; i < N_MEASURES; i++) {
+        for (size_t i = 0; i < n; i++) {
             dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * CHUNK_SIZE) % 10000 + 1);
+            dut_insert_head(get_random_string(),
+                            dut_length(input_data, i, mode));
             int before_size = q_size(l);
             before_ticks[i] = cpucycles();
             element_t *e = q_remove_head(l, NULL, 0);
@@ -129,11 +162,10 @@ bool measure(int64_t *before_ticks,
         }
         break;
     case DUT(remove_tail):
-        for (size_t i = 0; i < N_MEASURES; i++) {
+        for (size_t i = 0; i < n; i++) {
             dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * CHUNK_SIZE) % 10000 + 1);
+            dut_insert_head(get_random_string(),
+                            dut_length(input_data, i, mode));
             int before_size = q_size(l);
             before_ticks[i] = cpucycles();
             element_t *e = q_remove_tail(l, NULL, 0);
@@ -146,17 +178,50 @@ bool measure(int64_t *before_ticks,
                 return false;
         }
         break;
-    default:
-        for (size_t i = 0; i < N_MEASURES; i++) {
+    case DUT(size):
+        for (size_t i = 0; i < n; i++) {
             dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * CHUNK_SIZE) % 10000);
+            dut_insert_head(get_random_string(),
+                            dut_length(input_data, i, mode));
             before_ticks[i] = cpucycles();
             dut_size(1);
             after_ticks[i] = cpucycles();
             dut_free();
         }
+        break;
+    case DUT(delete_mid):
+        for (size_t i = 0; i < n; i++) {
+            dut_new();
+            dut_insert_head(get_random_string(),
+                            dut_length(input_data, i, mode));
+            int before_size = q_size(l);
+            before_ticks[i] = cpucycles();
+            bool ok = q_delete_mid(l);
+            after_ticks[i] = cpucycles();
+            int after_size = q_size(l);
+            dut_free();
+            if (!ok || before_size != after_size + 1)
+                return false;
+        }
+        break;
+    case DUT(swap):
+        for (size_t i = 0; i < n; i++) {
+            dut_new();
+            dut_insert_head(get_random_string(),
+                            dut_length(input_data, i, mode));
+            int before_size = q_size(l);
+            before_ticks[i] = cpucycles();
+            q_swap(l);
+            after_ticks[i] = cpucycles();
+            int after_size = q_size(l);
+            dut_free();
+            if (before_size != after_size)
+                return false;
+        }
+        break;
+    default:
+        assert(0 && "no such operation to measure");
+        return false;
     }
     return true;
 }
@@ -2,9 +2,10 @@
 #define DUDECT_CONSTANT_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
-/* Number of measurements per test */
+/* Default number of measurements per batch */
 #define N_MEASURES 150
 
 /* Allow random number range from 0 to 65535 */
@@ -12,11 +13,17 @@
 
 #define DROP_SIZE 20
 
+/* Queues measured on hold fewer elements than this */
+#define MAX_QUEUE_LENGTH 10000
+
 #define DUT_FUNCS  \
     _(insert_head) \
     _(insert_tail) \
     _(remove_head) \
-    _(remove_tail)
+    _(remove_tail) \
+    _(size)        \
+    _(delete_mid)  \
+    _(swap)
 
 #define DUT(x) DUT_##x
 
@@ -27,10 +34,13 @@ enum {
 };
 
 void init_dut();
-void prepare_inputs(uint8_t *input_data, uint8_t *classes);
+void release_dut(void);
+bool prepare_inputs(uint8_t *input_data, uint8_t *classes, size_t n);
+size_t dut_length(const uint8_t *input_data, size_t i, int mode);
 bool measure(int64_t *before_ticks,
              int64_t *after_ticks,
              uint8_t *input_data,
-             int mode);
+             int mode,
+             size_t n);
 
 #endif
@@ -24,17 +24,32 @@
  *
  *  - as long as any of the different test fails, the code will be deemed
  *    variable time.
+ *
+ *  - measurement batches are independent, so they can be spread over several
+ *    worker processes, each pinned to its own CPU. Every worker accumulates
+ *    its own statistics, which are merged afterwards. Processes rather than
+ *    threads are used because neither the allocation checker in harness.c
+ *    nor the queue under test is thread-safe.
  */
 
+/* CPU affinity needs _GNU_SOURCE, defined before anything is included */
+#if defined(__linux__)
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+
 #include <assert.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "../console.h"
 #include "../random.h"
+#include "../report.h"
 
 #include "constant.h"
 #include "fixture.h"
@@ -43,28 +58,74 @@
 #define ENOUGH_MEASURE 10000
 #define TEST_TRIES 10
 
+/* Bounds on the number of measurements per batch */
+#define MIN_MEASURES 10
+#define MAX_MEASURES (1 << 20)
+
 /* Number of percentiles to calculate */
 #define NUM_PERCENTILES (100)
 #define DUDECT_TESTS (NUM_PERCENTILES + 1)
 
+/* Upper bound on the number of worker processes */
+#define MAX_WORKERS 64
+
 static t_context_t *ctxs[DUDECT_TESTS];
 
+int dudect_workers = 1;
+int dudect_measures = N_MEASURES;
+int dudect_enough = ENOUGH_MEASURE;
+int dudect_tries = TEST_TRIES;
+int dudect_adaptive = 1;
+
+/* Size of the batches of the test being run, and how many of the fastest
+ * and slowest measurements of each are dropped, in proportion to DROP_SIZE
+ * out of N_MEASURES.
+ */
+static size_t n_measures = N_MEASURES;
+static size_t drop_size = DROP_SIZE;
+
+/* Sums for the least-squares fit of cycle counts against queue length, and
+ * the range of lengths they cover
+ */
+static struct fit_sums {
+    double n, sx, sy, sxx, sxy, syy;
+    double x_min, x_max;
+} fit;
+
+dudect_scaling_t dudect_scaling;
+
+/* Buffers for one batch, reused from batch to batch */
+static struct {
+    int64_t *before_ticks, *after_ticks, *exec_times;
+    uint8_t *classes, *input_data;
+    int64_t percentiles[NUM_PERCENTILES];
+    size_t size;
+} batch;
+
 /* threshold values for Welch's t-test */
 enum {
     t_threshold_bananas = 500, /* Test failed with overwhelming probability */
     t_threshold_moderate = 10, /* Test failed */
 };
 
+/* Set in worker processes, which share the buffers of the parent */
+static bool in_worker = false;
+
 static void __attribute__((noreturn)) die(void)
 {
+    /* Exit handlers of a worker would write out report and log output the
+     * parent had buffered when forking, a second time.
+     */
+    if (in_worker)
+        _exit(111);
     exit(111);
 }
 
-static int64_t percentile(const int64_t *a_sorted, double which, size_t size)
+/* Position of the given fraction in a sorted array of size elements */
+static size_t percentile_rank(double which, size_t size)
 {
     assert(which >= 0 && which <= 1.0);
-    size_t pos = (size_t) (which * size);
-    return a_sorted[pos];
+    return (size_t) (which * size);
 }
 
 /* leverages the fact that comparison expressions return 1 or 0. */
@@ -74,54 +135,267 @@ static int cmp(const void *aa, const void *bb)
     return (a > b) - (a < b);
 }
 
+static inline void swap_i64(int64_t *a, int64_t *b)
+{
+    int64_t t = *a;
+    *a = *b;
+    *b = t;
+}
+
+static void insertion_sort(int64_t *a, size_t n)
+{
+    for (size_t i = 1; i < n; i++) {
+        int64_t x = a[i];
+        size_t j = i;
+        for (; j > 0 && a[j - 1] > x; j--)
+            a[j] = a[j - 1];
+        a[j] = x;
+    }
+}
+
+/* Rearrange a[lo, hi) so that a[r] holds the element of rank r for each of
+ * the n ascending ranks, with smaller elements before it and larger ones
+ * after.  Quickselect only descends into the sides that still contain
+ * requested ranks; if pivots keep turning out poorly, the range is sorted
+ * instead, which bounds the worst case as in introselect.
+ */
+static void multiselect(int64_t *a,
+                        size_t lo,
+                        size_t hi,
+                        const size_t *ranks,
+                        size_t n,
+                        int depth)
+{
+    while (n > 0) {
+        if (hi - lo <= 16) {
+            insertion_sort(a + lo, hi - lo);
+            return;
+        }
+        if (depth-- == 0) {
+            qsort(a + lo, hi - lo, sizeof(int64_t), cmp);
+            return;
+        }
+
+        /* Median of three as pivot */
+        size_t mid = lo + (hi - lo) / 2;
+        if (a[mid] < a[lo])
+            swap_i64(&a[mid], &a[lo]);
+        if (a[hi - 1] < a[mid]) {
+            swap_i64(&a[hi - 1], &a[mid]);
+            if (a[mid] < a[lo])
+                swap_i64(&a[mid], &a[lo]);
+        }
+        int64_t pivot = a[mid];
+
+        /* Three-way partition, as cycle counts repeat a lot:
+         * [lo, lt) < pivot, [lt, gt) == pivot, [gt, hi) > pivot
+         */
+        size_t lt = lo, i = lo, gt = hi;
+        while (i < gt) {
+            if (a[i] < pivot)
+                swap_i64(&a[lt++], &a[i++]);
+            else if (a[i] > pivot)
+                swap_i64(&a[i], &a[--gt]);
+            else
+                i++;
+        }
+
+        /* Ranks that fall on the pivots are settled */
+        size_t left = 0;
+        while (left < n && ranks[left] < lt)
+            left++;
+        size_t right = left;
+        while (right < n && ranks[right] < gt)
+            right++;
+
+        multiselect(a, lo, lt, ranks, left, depth);
+        lo = gt;
+        ranks += right;
+        n -= right;
+    }
+}
+
 /* This function is used to set different thresholds for cropping measurements.
  * To filter out slow measurements, we keep only the fastest ones by a
  * complementary exponential decay scale as thresholds for cropping
  * measurements: threshold(x) = 1 - 0.5^(10 * x / N_MEASURES), where x is the
  * counter of the measurement.
+ *
+ * Only the order statistics needed are selected, rather than sorting the
+ * whole batch.  The drop_size fastest and slowest measurements are selected
+ * as well, so that update_statistics skips the same ones as with a sort.
  */
 static void prepare_percentiles(int64_t *exec_times, int64_t *percentiles)
 {
-    qsort(exec_times, N_MEASURES, sizeof(int64_t), cmp);
-
-    for (size_t i = 0; i < NUM_PERCENTILES; i++) {
-        percentiles[i] = percentile(
-            exec_times, 1 - (pow(0.5, 10 * (double) (i + 1) / NUM_PERCENTILES)),
-            N_MEASURES);
+    static size_t pos[NUM_PERCENTILES];
+    static size_t ranks[NUM_PERCENTILES + 2];
+    static size_t n_ranks = 0, ranks_for = 0;
+
+    if (ranks_for != n_measures) {
+        ranks_for = n_measures;
+        n_ranks = 0;
+        for (size_t i = 0; i < NUM_PERCENTILES; i++) {
+            pos[i] = percentile_rank(
+                1 - (pow(0.5, 10 * (double) (i + 1) / NUM_PERCENTILES)),
+                n_measures);
+        }
+        /* Merge the ascending positions with the drop_size boundaries */
+        size_t bounds[2] = {drop_size, n_measures - drop_size};
+        size_t i = 0, j = 0;
+        while (i < NUM_PERCENTILES || j < 2) {
+            size_t r = j == 2 || (i < NUM_PERCENTILES && pos[i] < bounds[j])
+                           ? pos[i++]
+                           : bounds[j++];
+            if ((!n_ranks || ranks[n_ranks - 1] != r) && r < n_measures)
+                ranks[n_ranks++] = r;
+        }
     }
+
+    int depth = 2;
+    for (size_t n = n_measures; n > 1; n >>= 1)
+        depth += 2;
+    multiselect(exec_times, 0, n_measures, ranks, n_ranks, depth);
+
+    for (size_t i = 0; i < NUM_PERCENTILES; i++)
+        percentiles[i] = exec_times[pos[i]];
 }
 
 static void differentiate(int64_t *exec_times,
                           const int64_t *before_ticks,
                           const int64_t *after_ticks)
 {
-    for (size_t i = 0; i < N_MEASURES; i++)
+    for (size_t i = 0; i < n_measures; i++)
         exec_times[i] = after_ticks[i] - before_ticks[i];
 }
 
+/* Number of cropping thresholds not above x, found by binary search since
+ * the thresholds are in ascending order.
+ */
+static size_t crop_bucket(const int64_t *percentiles, int64_t x)
+{
+    size_t lo = 0, n = NUM_PERCENTILES;
+    while (n > 0) {
+        size_t half = n / 2;
+        if (percentiles[lo + half] <= x) {
+            lo += half + 1;
+            n -= half + 1;
+        } else {
+            n = half;
+        }
+    }
+    return lo;
+}
+
 static void update_statistics(const int64_t *exec_times,
                               uint8_t *classes,
                               int64_t *percentiles)
 {
-    for (size_t i = DROP_SIZE; i < N_MEASURES - DROP_SIZE; i++) {
+    /* Rather than pushing every sample into each test it belongs to, sum the
+     * samples of each class by bucket: bucket b holds those below all but the
+     * first b cropping thresholds.  The t-test cropped at threshold j covers
+     * buckets 0 to j, and the uncropped one covers all of them, so each test
+     * takes a running total of the buckets in a single update.
+     */
+    double cnt[2][NUM_PERCENTILES + 1] = {{0}};
+    double sum[2][NUM_PERCENTILES + 1] = {{0}};
+    double sum_sq[2][NUM_PERCENTILES + 1] = {{0}};
+    double shift = percentiles[0];
+
+    for (size_t i = drop_size; i < n_measures - drop_size; i++) {
         int64_t difference = exec_times[i];
         /* CPU cycle counter overflowed or dropped measurement */
         if (difference <= 0)
             continue;
 
-        /* do a t-test on the execution time */
-        t_push(ctxs[0], difference, classes[i]);
+        uint8_t class = classes[i];
+        size_t b = crop_bucket(percentiles, difference);
+        double x = difference - shift;
+        cnt[class][b]++;
+        sum[class][b] += x;
+        sum_sq[class][b] += x * x;
+    }
 
-        /* t-test on cropped execution times, for several cropping thresholds.
-         */
-        for (size_t j = 0; j < NUM_PERCENTILES; j++) {
-            if (difference < percentiles[j]) {
-                t_push(ctxs[j + 1], difference, classes[i]);
-            }
+    for (uint8_t class = 0; class < 2; class ++) {
+        double n = 0, s = 0, sq = 0;
+        for (size_t j = 0; j <= NUM_PERCENTILES; j++) {
+            n += cnt[class][j];
+            s += sum[class][j];
+            sq += sum_sq[class][j];
+            /* t-test on cropped execution times, for several cropping
+             * thresholds, and finally on all of them.
+             */
+            t_context_t *ctx = j < NUM_PERCENTILES ? ctxs[j + 1] : ctxs[0];
+            t_push_sums(ctx, class, n, shift, s, sq);
         }
     }
 }
 
+/* Add the measurements of a batch to the scaling fit, leaving out the
+ * slowest few percent as the cropped t-tests do.
+ */
+static void update_scaling(const int64_t *before_ticks,
+                           const int64_t *after_ticks,
+                           const uint8_t *input_data,
+                           const int64_t *percentiles,
+                           int mode)
+{
+    int64_t threshold = percentiles[NUM_PERCENTILES / 2 - 1];
+    for (size_t i = 0; i < n_measures; i++) {
+        int64_t difference = after_ticks[i] - before_ticks[i];
+        if (difference <= 0 || difference >= threshold)
+            continue;
+        double x = dut_length(input_data, i, mode), y = difference;
+        if (!fit.n || x < fit.x_min)
+            fit.x_min = x;
+        if (!fit.n || x > fit.x_max)
+            fit.x_max = x;
+        fit.n++;
+        fit.sx += x;
+        fit.sy += y;
+        fit.sxx += x * x;
+        fit.sxy += x * y;
+        fit.syy += y * y;
+    }
+}
+
+/* Fit cycle counts to a + b * length and decide whether they grow linearly.
+ * Longer queues are slightly slower to work on even in constant time, as
+ * they spread over more cache lines, so besides being significant the slope
+ * has to dominate the time.  The fitted times at the shortest and longest
+ * queues differ by twice the time in the middle of that range when the cost
+ * is all per element, and by nothing when it is all fixed.  Above
+ * LINEAR_GROWTH, the fixed cost is less than a sixth of the time at the
+ * longest queue.
+ */
+#define LINEAR_GROWTH 1.5
+
+static void fit_scaling(void)
+{
+    memset(&dudect_scaling, 0, sizeof(dudect_scaling));
+    double n = fit.n;
+    double sxx = fit.sxx - fit.sx * fit.sx / n;
+    if (n < 3 || sxx <= 0)
+        return;
+    double sxy = fit.sxy - fit.sx * fit.sy / n;
+    double syy = fit.syy - fit.sy * fit.sy / n;
+
+    double slope = sxy / sxx;
+    double sse = fmax(syy - slope * sxy, 0.0);
+    double se = sqrt(sse / (n - 2) / sxx);
+    dudect_scaling.slope = slope;
+    dudect_scaling.intercept = (fit.sy - slope * fit.sx) / n;
+    dudect_scaling.t_value = se > 0 ? slope / se : 0;
+    dudect_scaling.min_length = fit.x_min;
+    dudect_scaling.max_length = fit.x_max;
+    double range = fit.x_max - fit.x_min;
+    double middle = dudect_scaling.intercept + slope * (fit.x_min + range / 2);
+    dudect_scaling.growth = middle > 0 ? slope * range / middle : 0;
+    dudect_scaling.significant =
+        dudect_scaling.t_value > t_threshold_moderate;
+    dudect_scaling.linear = dudect_scaling.significant &&
+                            dudect_scaling.growth > LINEAR_GROWTH;
+}
+
 static t_context_t *max_test()
 {
     size_t max_idx = 0;
@@ -136,20 +410,36 @@ static t_context_t *max_test()
     return ctxs[max_idx];
 }
 
-static bool report(void)
+/* Print how the test is going.  Return true if the code looks constant time
+ * so far, and set *done once more measurements would not change that.
+ */
+static bool report_progress(bool *done)
 {
     t_context_t *t = max_test();
     double number_traces_max_t = t->n[0] + t->n[1];
+    double max_t = fabs(t_compute(t));
+    double enough = dudect_enough;
+
+    /* Sequential testing: a huge t settles the test long before there are
+     * enough measurements.  So does a small one, if even growing with the
+     * square root of the number of measurements, as a real leak would, it
+     * stays well below the threshold up to enough measurements.
+     */
+    if (dudect_adaptive &&
+        (max_t > t_threshold_bananas ||
+         (number_traces_max_t >= enough / 4 &&
+          max_t * sqrt(enough / number_traces_max_t) <
+              t_threshold_moderate / 2)))
+        *done = true;
 
     printf("\033[A\033[2K");
     printf("measure: %7.2lf M, ", (number_traces_max_t / 1e6));
-    if (number_traces_max_t < ENOUGH_MEASURE) {
+    if (number_traces_max_t < enough && !*done) {
         printf("not enough measurements (%.0f still to go).\n",
-               ENOUGH_MEASURE - number_traces_max_t);
+               enough - number_traces_max_t);
         return false;
     }
 
-    double max_t = fabs(t_compute(t));
     double max_tau = max_t / sqrt(number_traces_max_t);
 
     /* max_t: the t statistic value
@@ -177,50 +467,216 @@ static bool report(void)
     return true;
 }
 
-static bool doit(int mode)
+/* The first batch of a test run only warms up caches and branch predictors;
+ * its measurements are not analyzed.
+ */
+static bool first_time = true;
+
+/* Make room in the batch buffers for n measurements */
+static void reserve_batch(size_t n)
 {
-    int64_t *before_ticks = calloc(N_MEASURES + 1, sizeof(int64_t));
-    int64_t *after_ticks = calloc(N_MEASURES + 1, sizeof(int64_t));
-    int64_t *exec_times = calloc(N_MEASURES, sizeof(int64_t));
-    uint8_t *classes = calloc(N_MEASURES, sizeof(uint8_t));
-    uint8_t *input_data = calloc(N_MEASURES * CHUNK_SIZE, sizeof(uint8_t));
-    int64_t *percentiles = calloc(NUM_PERCENTILES, sizeof(int64_t));
+    if (n <= batch.size)
+        return;
+
+    int64_t *before_ticks =
+        realloc(batch.before_ticks, (n + 1) * sizeof(int64_t));
+    if (before_ticks)
+        batch.before_ticks = before_ticks;
+    int64_t *after_ticks =
+        realloc(batch.after_ticks, (n + 1) * sizeof(int64_t));
+    if (after_ticks)
+        batch.after_ticks = after_ticks;
+    int64_t *exec_times = realloc(batch.exec_times, n * sizeof(int64_t));
+    if (exec_times)
+        batch.exec_times = exec_times;
+    uint8_t *classes = realloc(batch.classes, n);
+    if (classes)
+        batch.classes = classes;
+    uint8_t *input_data = realloc(batch.input_data, n * CHUNK_SIZE);
+    if (input_data)
+        batch.input_data = input_data;
 
     if (!before_ticks || !after_ticks || !exec_times || !classes ||
-        !input_data || !percentiles) {
+        !input_data) {
         die();
     }
+    batch.size = n;
+}
 
-    prepare_inputs(input_data, classes);
+static void free_batch(void)
+{
+    free(batch.before_ticks);
+    free(batch.after_ticks);
+    free(batch.exec_times);
+    free(batch.classes);
+    free(batch.input_data);
+    memset(&batch, 0, sizeof(batch));
+}
 
-    bool ret = measure(before_ticks, after_ticks, input_data, mode);
-    differentiate(exec_times, before_ticks, after_ticks);
-    prepare_percentiles(exec_times, percentiles);
+/* Measure one batch and add it to the statistics in ctxs.  Return false if
+ * the implementation under test misbehaved.
+ */
+static bool measure_batch(int mode)
+{
+    if (!prepare_inputs(batch.input_data, batch.classes, n_measures))
+        die();
+
+    bool ret = measure(batch.before_ticks, batch.after_ticks, batch.input_data,
+                       mode, n_measures);
+    differentiate(batch.exec_times, batch.before_ticks, batch.after_ticks);
+    prepare_percentiles(batch.exec_times, batch.percentiles);
 
-    /* This warm-up step discards the first measurement batch by skipping
-     * its statistical analysis. A static boolean flag controls this by
-     * marking the initial execution, ensuring only the first call within
-     * a test run is excluded from the t-test computation.
-     */
-    static bool first_time = true;
     if (first_time) {
         first_time = false;
         ret = true;
     } else {
-        update_statistics(exec_times, classes, percentiles);
-        ret &= report();
+        update_statistics(batch.exec_times, batch.classes, batch.percentiles);
+        update_scaling(batch.before_ticks, batch.after_ticks, batch.input_data,
+                       batch.percentiles, mode);
     }
 
-    free(before_ticks);
-    free(after_ticks);
-    free(exec_times);
-    free(classes);
-    free(input_data);
-    free(percentiles);
+    return ret;
+}
 
+static bool doit(int mode, bool *done)
+{
+    bool warm_up = first_time;
+    bool ret = measure_batch(mode);
+    if (!warm_up)
+        ret &= report_progress(done);
     return ret;
 }
 
+/* Bind the calling process to the k-th CPU it is allowed to run on */
+static void pin_worker(int k)
+{
+#if defined(__linux__)
+    cpu_set_t allowed, set;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed))
+        return;
+    int target = k % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && target-- == 0) {
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            sched_setaffinity(0, sizeof(set), &set);
+            return;
+        }
+    }
+#else
+    (void) k;
+#endif
+}
+
+static bool xfer(int fd, void *buf, size_t len, bool out)
+{
+    char *p = buf;
+    while (len) {
+        ssize_t n = out ? write(fd, p, len) : read(fd, p, len);
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Body of a worker process: measure its share of batches into fresh
+ * statistics and send them back to the parent through fd.
+ */
+static void __attribute__((noreturn)) worker(int k, int fd, int mode, int n)
+{
+    in_worker = true;
+    pin_worker(k);
+    random_reseed();
+    for (size_t i = 0; i < DUDECT_TESTS; i++)
+        t_init(ctxs[i]);
+    memset(&fit, 0, sizeof(fit));
+    first_time = true;
+
+    bool ok = true;
+    for (int i = 0; i < n + 1; i++)
+        ok &= measure_batch(mode);
+
+    bool sent = xfer(fd, &ok, sizeof(ok), true);
+    for (size_t i = 0; sent && i < DUDECT_TESTS; i++)
+        sent = xfer(fd, ctxs[i], sizeof(t_context_t), true);
+    if (sent)
+        sent = xfer(fd, &fit, sizeof(fit), true);
+    /* Skip exit handlers, as die() does in workers */
+    _exit(sent ? 0 : 1);
+}
+
+/* Run n batches spread over dudect_workers processes and merge their
+ * statistics into ctxs.
+ */
+static bool doit_parallel(int mode, int n)
+{
+    int workers = dudect_workers > MAX_WORKERS ? MAX_WORKERS : dudect_workers;
+    pid_t pids[MAX_WORKERS];
+    int fds[MAX_WORKERS];
+    int started = 0;
+    bool ret = true;
+
+    /* Nothing buffered may be written twice by the children, including
+     * what the report module keeps in its own buffers
+     */
+    report_flush();
+    fflush(stdout);
+    for (; started < workers; started++) {
+        int pipefd[2];
+        if (pipe(pipefd))
+            break;
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(pipefd[0]);
+            close(pipefd[1]);
+            break;
+        }
+        if (pid == 0) {
+            close(pipefd[0]);
+            worker(started, pipefd[1], mode, (n + workers - 1) / workers);
+        }
+        close(pipefd[1]);
+        pids[started] = pid;
+        fds[started] = pipefd[0];
+    }
+    if (!started)
+        die();
+
+    t_context_t part;
+    for (int k = 0; k < started; k++) {
+        bool ok = false;
+        if (!xfer(fds[k], &ok, sizeof(ok), false))
+            die();
+        ret &= ok;
+        for (size_t i = 0; i < DUDECT_TESTS; i++) {
+            if (!xfer(fds[k], &part, sizeof(part), false))
+                die();
+            t_merge(ctxs[i], &part);
+        }
+        /* The fit is made of plain sums, which simply add up, and a range */
+        struct fit_sums part_fit;
+        if (!xfer(fds[k], &part_fit, sizeof(part_fit), false))
+            die();
+        if (part_fit.n && (!fit.n || part_fit.x_min < fit.x_min))
+            fit.x_min = part_fit.x_min;
+        if (part_fit.n && (!fit.n || part_fit.x_max > fit.x_max))
+            fit.x_max = part_fit.x_max;
+        fit.n += part_fit.n;
+        fit.sx += part_fit.sx;
+        fit.sy += part_fit.sy;
+        fit.sxx += part_fit.sxx;
+        fit.sxy += part_fit.sxy;
+        fit.syy += part_fit.syy;
+        close(fds[k]);
+        waitpid(pids[k], NULL, 0);
+    }
+
+    bool done = false;
+    return report_progress(&done) && ret;
+}
+
 static void init_once(void)
 {
     init_dut();
@@ -241,11 +697,26 @@ static bool test_const(char *text, int mode)
 
     init_once();
 
-    for (int cnt = 0; cnt < TEST_TRIES; ++cnt) {
-        printf("Testing %s...(%d/%d)\n\n", text, cnt, TEST_TRIES);
-        for (int i = 0; i < ENOUGH_MEASURE / (N_MEASURES - DROP_SIZE * 2) + 1;
-             ++i)
-            result = doit(mode);
+    n_measures = dudect_measures;
+    if (n_measures < MIN_MEASURES)
+        n_measures = MIN_MEASURES;
+    if (n_measures > MAX_MEASURES)
+        n_measures = MAX_MEASURES;
+    drop_size = n_measures * DROP_SIZE / N_MEASURES;
+    reserve_batch(n_measures);
+    memset(&fit, 0, sizeof(fit));
+
+    int tries = dudect_tries > 0 ? dudect_tries : 1;
+    for (int cnt = 0; cnt < tries; ++cnt) {
+        printf("Testing %s...(%d/%d)\n\n", text, cnt, tries);
+        int batches = dudect_enough / (n_measures - drop_size * 2) + 1;
+        if (dudect_workers > 1) {
+            result = doit_parallel(mode, batches);
+        } else {
+            bool done = false;
+            for (int i = 0; i < batches && !done; ++i)
+                result = doit(mode, &done);
+        }
         printf("\033[A\033[2K\033[A\033[2K");
         if (result)
             break;
@@ -255,6 +726,9 @@ static bool test_const(char *text, int mode)
         free(ctxs[i]);
         ctxs[i] = NULL;
     }
+    free_batch();
+    release_dut();
+    fit_scaling();
 
     return result;
 }
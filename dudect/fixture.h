@@ -4,6 +4,31 @@
 #include <stdbool.h>
 #include "constant.h"
 
+/* Number of worker processes measuring in parallel */
+extern int dudect_workers;
+/* Measurements per batch, in total and tries before giving up */
+extern int dudect_measures;
+extern int dudect_enough;
+extern int dudect_tries;
+/* Stop measuring as soon as the outcome is clear */
+extern int dudect_adaptive;
+
+/* How the cycles taken by the operation last tested grow with the queue
+ * length, from a least-squares fit of cycles = intercept + slope * length.
+ */
+typedef struct {
+    double slope;      /* cycles per element */
+    double intercept;  /* cycles on an empty queue */
+    double t_value;    /* significance of the slope */
+    double growth;     /* rise over the lengths tested, per time midway */
+    double min_length; /* shortest queue tested */
+    double max_length; /* longest queue tested */
+    bool significant;  /* the slope is not just noise */
+    bool linear;       /* the time is mostly a cost per element */
+} dudect_scaling_t;
+
+extern dudect_scaling_t dudect_scaling;
+
 /* Interface to test if function is constant */
 #define _(x) bool is_##x##_const(void);
 DUT_FUNCS
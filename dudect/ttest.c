@@ -27,6 +27,46 @@ void t_push(t_context_t *ctx, double x, uint8_t class)
     ctx->m2[class] = ctx->m2[class] + delta * (x - ctx->mean[class]);
 }
 
+/* Add n samples of class, given by the sum and the sum of squares of their
+ * differences from shift.  Shifting the samples to near their mean keeps the
+ * sums small enough for the variance to be computed from them accurately.
+ */
+void t_push_sums(t_context_t *ctx,
+                 uint8_t class,
+                 double n,
+                 double shift,
+                 double sum,
+                 double sum_sq)
+{
+    assert(class == 0 || class == 1);
+    if (n == 0)
+        return;
+
+    t_context_t batch;
+    t_init(&batch);
+    batch.n[class] = n;
+    batch.mean[class] = shift + sum / n;
+    batch.m2[class] = fmax(sum_sq - sum * sum / n, 0.0);
+    t_merge(ctx, &batch);
+}
+
+/* Combine the samples accumulated in src into dst, using the pairwise update
+ * of Chan et al. for the means and sums of squared differences.
+ */
+void t_merge(t_context_t *dst, const t_context_t *src)
+{
+    for (int class = 0; class < 2; class ++) {
+        double n = dst->n[class] + src->n[class];
+        if (src->n[class] == 0)
+            continue;
+        double delta = src->mean[class] - dst->mean[class];
+        dst->mean[class] += delta * src->n[class] / n;
+        dst->m2[class] +=
+            src->m2[class] + delta * delta * dst->n[class] * src->n[class] / n;
+        dst->n[class] = n;
+    }
+}
+
 double t_compute(t_context_t *ctx)
 {
     double var[2] = {0.0, 0.0};
@@ -10,6 +10,13 @@ typedef struct {
 } t_context_t;
 
 void t_push(t_context_t *ctx, double x, uint8_t class);
+void t_push_sums(t_context_t *ctx,
+                 uint8_t class,
+                 double n,
+                 double shift,
+                 double sum,
+                 double sum_sq);
+void t_merge(t_context_t *dst, const t_context_t *src);
 double t_compute(t_context_t *ctx);
 void t_init(t_context_t *ctx);
 
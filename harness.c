@@ -1,5 +1,6 @@
 /* Test support code */
 
+#include <math.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdint.h>
@@ -36,11 +37,18 @@
 typedef struct __block_element {
     struct __block_element *next, *prev;
     size_t payload_size;
-    size_t magic_header; /* Marker to see if block seems legitimate */
+    float memo;            /* Cached by block_memo() users, NaN if unset */
+    uint32_t magic_header; /* Marker to see if block seems legitimate */
     unsigned char payload[0];
     /* Also place magic number at tail of every block */
 } block_element_t;
 
+/* The memo shares a word with the header marker, so that the header is no
+ * larger than before and the payload stays 16-byte aligned, as from malloc.
+ */
+_Static_assert(sizeof(block_element_t) % 16 == 0,
+               "payload of allocated blocks must stay 16-byte aligned");
+
 static block_element_t *allocated = NULL;
 static size_t allocated_count = 0;
 
@@ -156,6 +164,8 @@ static void *alloc(alloc_t alloc_type, size_t size)
     new_block->magic_header = MAGICHEADER;
     // cppcheck-suppress nullPointerRedundantCheck
     new_block->payload_size = size;
+    // cppcheck-suppress nullPointerRedundantCheck
+    new_block->memo = NAN;
     *find_footer(new_block) = MAGICFOOTER;
     void *p = (void *) &new_block->payload;
     memset(p, !alloc_type * FILLCHAR, size);
@@ -199,9 +209,11 @@ void *test_realloc(void *p, size_t new_size)
     if (!p)
         return alloc(TEST_REALLOC, new_size);
 
-    const block_element_t *b = find_header(p);
-    if (b->payload_size >= new_size)
+    block_element_t *b = find_header(p);
+    if (b->payload_size >= new_size) {
+        b->memo = NAN;
         return p;
+    }
 
     void *new_ptr = alloc(TEST_REALLOC, new_size);
     if (!new_ptr)
@@ -249,6 +261,22 @@ void test_free(void *p)
     allocated_count--;
 }
 
+float *block_memo(void *p)
+{
+    if (!p)
+        return NULL;
+
+    /* Searching the list of allocated blocks, as find_header() does in
+     * cautious mode, would cost more than the value being cached.  The magic
+     * numbers at both ends tell a live block apart in constant time.
+     */
+    block_element_t *b =
+        (block_element_t *) ((size_t) p - sizeof(block_element_t));
+    if (b->magic_header != MAGICHEADER || *find_footer(b) != MAGICFOOTER)
+        return NULL;
+    return &b->memo;
+}
+
 // cppcheck-suppress unusedFunction
 char *test_strdup(const char *s)
 {
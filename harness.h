@@ -36,6 +36,13 @@ void set_cautious_mode(bool cautious);
  */
 void set_noallocate_mode(bool noallocate);
 
+/* Slot for caching a value computed from the contents of block p, such as the
+ * entropy of a string that does not change after it is allocated.  The slot
+ * holds NaN until it is set, and is reset when the block is reallocated.
+ * Return NULL if the magic numbers around p do not mark an allocated block.
+ */
+float *block_memo(void *p);
+
 /* Return whether any errors have occurred since last time checked */
 bool error_check();
 
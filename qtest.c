@@ -3,8 +3,10 @@
 #include <assert.h>
 #include <errno.h>
 #include <getopt.h>
+#include <math.h>
 #include <signal.h>
 #include <spawn.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,9 +24,9 @@
 #include "dudect/fixture.h"
 #include "list.h"
 #include "random.h"
+#include "shannon_entropy.h"
 
 /* Shannon entropy */
-extern double shannon_entropy(const uint8_t *input_data);
 extern int show_entropy;
 
 /* Our program needs to use regular malloc/free */
@@ -75,9 +77,57 @@ static int string_length = MAXSTRING;
 
 static int descend = 0;
 
+/* Queues longer than this are only checked near their ends after inserting
+ * or removing at an end.  Other commands and verify check them in full.
+ */
+static int check_limit = 10000;
+
+/* Set by the last command when it changed only the ends of the queue */
+static bool ends_only = false;
+
+/* Seed of the strings generated for RAND insertions, 0 to seed from the OS */
+static int rand_seed = 0;
+
 #define MIN_RANDSTR_LEN 5
 #define MAX_RANDSTR_LEN 10
+/* Length of the prefix shared by the strings of the "prefix" distribution */
+#define RANDSTR_PREFIX_LEN 32
+/* Space taken by each generated string */
+#define RANDSTR_SLOT (RANDSTR_PREFIX_LEN + MAX_RANDSTR_LEN)
+/* Number of random strings generated at once for RAND insertions */
+#define RANDSTR_BATCH 256
+/* Number of distinct strings of the "zipf" and "few" distributions */
+#define ZIPF_VOCABULARY 1024
+#define FEW_VOCABULARY 8
+/* Keys of the "sorted" and "reverse" distributions are written as
+ * MAX_RANDSTR_LEN - 1 base-26 digits, so there are 26^9 of them.
+ */
+#define KEY_SPACE 5429503678976ULL
 static const char charset[] = "abcdefghijklmnopqrstuvwxyz";
+
+/* Distributions of the strings generated for RAND insertions */
+typedef enum {
+    DIST_UNIFORM,
+    DIST_ZIPF,
+    DIST_SORTED,
+    DIST_REVERSE,
+    DIST_FEW,
+    DIST_PREFIX,
+    DIST_COUNT,
+} dist_t;
+
+static const char *const dist_names[DIST_COUNT] = {
+    "uniform", "zipf", "sorted", "reverse", "few", "prefix",
+};
+
+/* Generator state for the strings of one insert command */
+typedef struct {
+    dist_t dist;
+    uint64_t salt; /* Picks the vocabulary of "zipf" and "few" */
+    uint64_t key;  /* Last key of "sorted" and "reverse" */
+    uint64_t step; /* Largest gap between consecutive keys, less one */
+    char prefix[RANDSTR_PREFIX_LEN];
+} randstr_gen_t;
 /* For queue_insert and queue_remove */
 typedef enum {
     POS_TAIL,
@@ -163,21 +213,153 @@ static bool do_new(int argc, char *argv[])
     return ok && !error_check();
 }
 
-/* TODO: Add a buf_size check of if the buf_size may be less
- * than MIN_RANDSTR_LEN.
+/* Write a random string of MIN_RANDSTR_LEN to MAX_RANDSTR_LEN - 1
+ * characters.  Each 64-bit random word is split into four 16-bit lanes, and a
+ * lane is mapped onto a range with a multiply and a shift rather than a
+ * division.  The bias this leaves is below 26 / 65536 per character.
+ */
+static void fill_uniform(char *buf)
+{
+    uint64_t x = random_u64();
+    size_t len = MIN_RANDSTR_LEN +
+                 (((x & 0xffff) * (MAX_RANDSTR_LEN - MIN_RANDSTR_LEN)) >> 16);
+    int lanes = 3;
+    x >>= 16;
+    for (size_t n = 0; n < len; n++) {
+        if (!lanes) {
+            x = random_u64();
+            lanes = 4;
+        }
+        buf[n] = charset[((x & 0xffff) * (sizeof(charset) - 1)) >> 16];
+        x >>= 16;
+        lanes--;
+    }
+    buf[len] = '\0';
+}
+
+/* Write key as fixed-width base-26 digits, so that strings compare in the
+ * same order as their keys.
  */
-static void fill_rand_string(char *buf, size_t buf_size)
+static void fill_key(char *buf, uint64_t key)
 {
-    size_t len = 0;
-    while (len < MIN_RANDSTR_LEN)
-        len = rand() % buf_size;
+    for (int n = MAX_RANDSTR_LEN - 2; n >= 0; n--) {
+        buf[n] = charset[key % (sizeof(charset) - 1)];
+        key /= sizeof(charset) - 1;
+    }
+    buf[MAX_RANDSTR_LEN - 1] = '\0';
+}
 
-    uint64_t randstr_buf_64[MAX_RANDSTR_LEN] = {0};
-    randombytes((uint8_t *) randstr_buf_64, len * sizeof(uint64_t));
-    for (size_t n = 0; n < len; n++)
-        buf[n] = charset[randstr_buf_64[n] % (sizeof(charset) - 1)];
+/* Word i of a vocabulary picked by salt */
+static void fill_word(char *buf, uint64_t salt, uint64_t i)
+{
+    fill_key(buf, random_shuffle((uintptr_t) (salt + i)) % KEY_SPACE);
+}
 
-    buf[len] = '\0';
+/* Rank of a word drawn from a Zipf distribution with exponent 1, by binary
+ * search in its cumulative distribution.
+ */
+static uint64_t zipf_rank(void)
+{
+    static double cdf[ZIPF_VOCABULARY];
+    if (cdf[ZIPF_VOCABULARY - 1] == 0) {
+        double sum = 0;
+        for (int k = 0; k < ZIPF_VOCABULARY; k++)
+            cdf[k] = sum += 1.0 / (k + 1);
+        for (int k = 0; k < ZIPF_VOCABULARY; k++)
+            cdf[k] /= sum;
+    }
+
+    double u = (random_u64() >> 11) * 0x1.0p-53;
+    uint64_t lo = 0, hi = ZIPF_VOCABULARY - 1;
+    while (lo < hi) {
+        uint64_t mid = (lo + hi) / 2;
+        if (cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Prepare to generate reps strings of the given distribution */
+static void init_rand_strings(randstr_gen_t *gen, dist_t dist, int reps)
+{
+    gen->dist = dist;
+    gen->salt = random_u64();
+    /* Keys start in the lower half and cannot run past the upper half */
+    gen->step = KEY_SPACE / 2 / reps - 1;
+    gen->key = random_u64() % (KEY_SPACE / 2);
+    if (dist == DIST_REVERSE)
+        gen->key = KEY_SPACE - 1 - gen->key;
+    for (size_t n = 0; n < RANDSTR_PREFIX_LEN; n++)
+        gen->prefix[n] = charset[random_u64() % (sizeof(charset) - 1)];
+}
+
+/* Fill count slots of RANDSTR_SLOT bytes with the next strings of gen */
+static void fill_rand_strings(randstr_gen_t *gen, char *buf, size_t count)
+{
+    for (size_t i = 0; i < count; i++, buf += RANDSTR_SLOT) {
+        switch (gen->dist) {
+        case DIST_UNIFORM:
+            fill_uniform(buf);
+            break;
+        case DIST_ZIPF:
+            fill_word(buf, gen->salt, zipf_rank());
+            break;
+        case DIST_SORTED:
+            gen->key += 1 + (((random_u64() & 0xffff) * gen->step) >> 16);
+            fill_key(buf, gen->key);
+            break;
+        case DIST_REVERSE:
+            gen->key -= 1 + (((random_u64() & 0xffff) * gen->step) >> 16);
+            fill_key(buf, gen->key);
+            break;
+        case DIST_FEW:
+            fill_word(buf, gen->salt,
+                      ((random_u64() & 0xffff) * FEW_VOCABULARY) >> 16);
+            break;
+        case DIST_PREFIX:
+            memcpy(buf, gen->prefix, RANDSTR_PREFIX_LEN);
+            fill_uniform(buf + RANDSTR_PREFIX_LEN);
+            break;
+        default:
+            assert(0);
+        }
+    }
+}
+
+/* Report how the time taken by the operation measured last grows with the
+ * length of the queue.
+ */
+static void report_scaling()
+{
+    const dudect_scaling_t *sc = &dudect_scaling;
+    report(1,
+           "Scaling: %.1f + %.4f * length cycles (slope t = %.1f), "
+           "rising by %.0f%% of the time midway over lengths %.0f to %.0f",
+           sc->intercept, sc->slope, sc->t_value, sc->growth * 100,
+           sc->min_length, sc->max_length);
+    if (sc->linear)
+        report(1, "Likely O(n): the time is mostly a cost per element");
+    else if (sc->significant)
+        report(1, "Likely O(1): the time grows, but a fixed cost dominates it "
+                  "over these lengths");
+    else
+        report(1, "Likely O(1): the time does not grow significantly");
+}
+
+/* Measure an operation that may legitimately take linear time.  How its
+ * timing scales is reported rather than checked.
+ */
+static bool simulate_scaling(int argc, char *argv[], bool (*is_const)(void))
+{
+    if (argc != 1) {
+        report(1, "%s does not need arguments in simulation mode", argv[0]);
+        return false;
+    }
+    is_const();
+    report_scaling();
+    return true;
 }
 
 /* insertion */
@@ -190,6 +372,7 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
         }
         bool ok =
             pos == POS_TAIL ? is_insert_tail_const() : is_insert_head_const();
+        report_scaling();
         if (!ok) {
             report(1,
                    "ERROR: Probably not constant time or wrong implementation");
@@ -200,16 +383,18 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
     }
 
     char *lasts = NULL;
-    char randstr_buf[MAX_RANDSTR_LEN];
+    char randstr_buf[RANDSTR_BATCH][RANDSTR_SLOT];
+    randstr_gen_t gen = {0};
+    dist_t dist = DIST_UNIFORM;
     int reps = 1;
     bool ok = true, need_rand = false;
-    if (argc != 2 && argc != 3) {
-        report(1, "%s needs 1-2 arguments", argv[0]);
+    if (argc < 2 || argc > 4) {
+        report(1, "%s needs 1-3 arguments", argv[0]);
         return false;
     }
 
     char *inserts = argv[1];
-    if (argc == 3) {
+    if (argc >= 3) {
         if (!get_int(argv[2], &reps) || reps < 1) {
             report(1, "Invalid number of insertions '%s'", argv[2]);
             return false;
@@ -218,8 +403,26 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
 
     if (!strcmp(inserts, "RAND")) {
         need_rand = true;
-        inserts = randstr_buf;
+        inserts = randstr_buf[0];
+    }
+
+    if (argc == 4) {
+        if (!need_rand) {
+            report(1, "Distribution '%s' needs RAND strings", argv[3]);
+            return false;
+        }
+        while (dist < DIST_COUNT && strcmp(argv[3], dist_names[dist]))
+            dist++;
+        if (dist == DIST_COUNT) {
+            report(1,
+                   "Unknown distribution '%s' (uniform, zipf, sorted, "
+                   "reverse, few or prefix)",
+                   argv[3]);
+            return false;
+        }
     }
+    if (need_rand)
+        init_rand_strings(&gen, dist, reps);
 
     if (!current || !current->q)
         report(3, "Warning: Calling insert %s on null queue",
@@ -228,8 +431,13 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
 
     if (current && exception_setup(true)) {
         for (int r = 0; ok && r < reps; r++) {
-            if (need_rand)
-                fill_rand_string(randstr_buf, sizeof(randstr_buf));
+            if (need_rand) {
+                if (r % RANDSTR_BATCH == 0)
+                    fill_rand_strings(&gen, randstr_buf[0],
+                                      reps - r < RANDSTR_BATCH ? reps - r
+                                                               : RANDSTR_BATCH);
+                inserts = randstr_buf[r % RANDSTR_BATCH];
+            }
             bool rval = pos == POS_TAIL ? q_insert_tail(current->q, inserts)
                                         : q_insert_head(current->q, inserts);
             if (rval) {
@@ -272,6 +480,7 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
     }
     exception_cancel();
 
+    ends_only = true;
     q_show(3);
     return ok;
 }
@@ -302,6 +511,7 @@ static bool queue_remove(position_t pos, int argc, char *argv[])
         }
         bool ok =
             pos == POS_TAIL ? is_remove_tail_const() : is_remove_head_const();
+        report_scaling();
         if (!ok) {
             report(1,
                    "ERROR: Probably not constant time or wrong implementation");
@@ -400,6 +610,7 @@ static bool queue_remove(position_t pos, int argc, char *argv[])
         ok = false;
     }
 
+    ends_only = true;
     q_show(3);
 
     free(removes);
@@ -535,6 +746,9 @@ static bool do_reverse(int argc, char *argv[])
 
 static bool do_size(int argc, char *argv[])
 {
+    if (simulation)
+        return simulate_scaling(argc, argv, is_size_const);
+
     if (argc != 1 && argc != 2) {
         report(1, "%s takes 0-1 arguments", argv[0]);
         return false;
@@ -576,6 +790,93 @@ static bool do_size(int argc, char *argv[])
     return ok && !error_check();
 }
 
+/* Most nodes whose position is recorded to check the stability of sort.
+ * Longer queues have evenly spaced nodes recorded, which keeps the table
+ * small enough to stay in cache rather than evict the queue being sorted.
+ */
+#define SORT_CHECK_NODES (1 << 16)
+
+/* Position of a node before sorting.  The positions are kept in an
+ * open-addressing hash table keyed by node address, at most half full, so
+ * that it is built in linear time and each lookup takes constant time.
+ */
+typedef struct {
+    const struct list_head *node;
+    size_t index;
+} node_index_t;
+
+/* Number of slots of the table for a queue of n nodes, a power of two */
+static size_t index_slots(size_t n)
+{
+    if (n > SORT_CHECK_NODES)
+        n = SORT_CHECK_NODES;
+    size_t slots = 2;
+    while (slots < 2 * n)
+        slots <<= 1;
+    return slots;
+}
+
+/* First slot to probe for node, in a table with mask + 1 slots */
+static inline size_t index_slot(const struct list_head *node, size_t mask)
+{
+    /* Recorded nodes can be any multiple of the allocation size apart, so
+     * mix all the bits of the address into the slot.
+     */
+    uint64_t h = ((uintptr_t) node >> 4) * 0x9e3779b97f4a7c15ULL;
+    return (h >> 32) & mask;
+}
+
+/* Record the position of the first n nodes of head, or of evenly spaced ones
+ * if n is larger than SORT_CHECK_NODES.  Return NULL if there is no memory
+ * for the table.  The number of nodes found is stored in count, which is
+ * n + 1 if head has more than n nodes.
+ */
+static node_index_t *index_nodes(struct list_head *head,
+                                 size_t n,
+                                 size_t *count)
+{
+    size_t mask = index_slots(n) - 1;
+    size_t stride = (n + SORT_CHECK_NODES - 1) / SORT_CHECK_NODES;
+    node_index_t *order = calloc(mask + 1, sizeof(node_index_t));
+    if (!order)
+        return NULL;
+
+    size_t i = 0;
+    struct list_head *node;
+    list_for_each(node, head) {
+        if (i == n) {
+            i++;
+            break;
+        }
+        if (i % stride == 0) {
+            size_t k = index_slot(node, mask);
+            while (order[k].node)
+                k = (k + 1) & mask;
+            order[k].node = node;
+            order[k].index = i;
+        }
+        i++;
+    }
+    *count = i;
+    return order;
+}
+
+/* Position of node before sorting, or SIZE_MAX if it is not one of the
+ * nodes recorded in order by index_nodes() for a queue of n nodes.
+ */
+static size_t node_index(const node_index_t *order,
+                         size_t n,
+                         const struct list_head *node)
+{
+    size_t mask = index_slots(n) - 1;
+    for (size_t k = index_slot(node, mask); order[k].node;
+         k = (k + 1) & mask) {
+        if (order[k].node == node)
+            return order[k].index;
+    }
+    return SIZE_MAX;
+}
+
 bool do_sort(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -594,31 +895,39 @@ bool do_sort(int argc, char *argv[])
         report(3, "Warning: Calling sort on single node");
     error_check();
 
-    set_noallocate_mode(true);
-
-/* If the number of elements is too large, it may take a long time to check the
- * stability of the sort. So, MAX_NODES is used to limit the number of elements
- * to check the stability of the sort. */
-#define MAX_NODES 100000
-    struct list_head *nodes[MAX_NODES];
-    unsigned no = 0;
-    if (current && current->size && current->size <= MAX_NODES) {
-        element_t *entry;
-        list_for_each_entry(entry, current->q, list)
-            nodes[no++] = &entry->list;
-    } else if (current && current->size > MAX_NODES)
-        report(1,
-               "Warning: Skip checking the stability of the sort because the "
-               "number of elements %d is too large, exceeds the limit %d.",
-               current->size, MAX_NODES);
+    /* Remember the original order of the nodes to check the stability */
+    bool ok = true;
+    node_index_t *order = NULL;
+    size_t no = 0;
+    if (current && current->size > 0) {
+        size_t size = current->size;
+        order = index_nodes(current->q, size, &no);
+        if (!order) {
+            report(1,
+                   "Warning: Skip checking the stability of the sort because "
+                   "there is no memory to record the order of %zu elements.",
+                   size);
+        } else if (no != size) {
+            report(1, "ERROR: Queue has %s%zu elements, but its size is %zu",
+                   no > size ? "more than " : "", no > size ? size : no, size);
+            ok = false;
+            free(order);
+            order = NULL;
+        }
+    }
 
+    set_noallocate_mode(true);
     if (current && exception_setup(true))
         q_sort(current->q, descend);
     exception_cancel();
     set_noallocate_mode(false);
 
-    bool ok = true;
     if (current && current->size) {
+        /* Position of the last recorded node in the current run of
+         * duplicates, and whether cur_l is already part of such a run
+         */
+        size_t pos = SIZE_MAX;
+        bool in_run = false;
         for (struct list_head *cur_l = current->q->next;
              cur_l != current->q && --cnt; cur_l = cur_l->next) {
             /* Ensure each element in ascending/descending order */
@@ -636,32 +945,32 @@ bool do_sort(int argc, char *argv[])
                 ok = false;
                 break;
             }
-            /* Ensure the stability of the sort */
-            if (current->size <= MAX_NODES &&
-                !strcmp(item->value, next_item->value)) {
-                bool unstable = false;
-                for (unsigned i = 0; i < MAX_NODES; i++) {
-                    if (nodes[i] == cur_l->next) {
-                        unstable = true;
-                        break;
-                    }
-                    if (nodes[i] == cur_l) {
+            /* Ensure the stability of the sort: the recorded nodes of a run
+             * of duplicates have to keep their original order.
+             */
+            if (order && !strcmp(item->value, next_item->value)) {
+                if (!in_run) {
+                    pos = node_index(order, no, cur_l);
+                    in_run = true;
+                }
+                size_t j = node_index(order, no, cur_l->next);
+                if (j != SIZE_MAX) {
+                    if (pos != SIZE_MAX && j < pos) {
+                        report(1,
+                               "ERROR: Not stable sort. The duplicate strings "
+                               "\"%s\" are not in the same order.",
+                               item->value);
+                        ok = false;
                         break;
                     }
+                    pos = j;
                 }
-                if (unstable) {
-                    report(
-                        1,
-                        "ERROR: Not stable sort. The duplicate strings \"%s\" "
-                        "are not in the same order.",
-                        item->value);
-                    ok = false;
-                    break;
-                }
+            } else {
+                in_run = false;
             }
         }
     }
-#undef MAX_NODES
+    free(order);
 
     q_show(3);
     return ok && !error_check();
@@ -669,6 +978,9 @@ bool do_sort(int argc, char *argv[])
 
 static bool do_dm(int argc, char *argv[])
 {
+    if (simulation)
+        return simulate_scaling(argc, argv, is_delete_mid_const);
+
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
         return false;
@@ -695,6 +1007,9 @@ static bool do_dm(int argc, char *argv[])
 
 static bool do_swap(int argc, char *argv[])
 {
+    if (simulation)
+        return simulate_scaling(argc, argv, is_swap_const);
+
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
         return false;
@@ -937,38 +1252,116 @@ static bool is_circular()
     return true;
 }
 
+/* Check the first and last depth links of the current queue in both
+ * directions.  Insertions and removals at either end only touch these, so
+ * this is all q_show checks after them on long queues.
+ */
+static bool ends_linked(int depth)
+{
+    struct list_head *head = current->q;
+    struct list_head *cur = head;
+    for (int i = 0; i < depth && (i == 0 || cur != head); i++) {
+        if (!cur->next || cur->next->prev != cur)
+            return false;
+        cur = cur->next;
+    }
+
+    cur = head;
+    for (int i = 0; i < depth && (i == 0 || cur != head); i++) {
+        if (!cur->prev || cur->prev->next != cur)
+            return false;
+        cur = cur->prev;
+    }
+    return true;
+}
+
+/* Line assembled by q_show, kept across calls to avoid reallocation */
+static char *show_buf = NULL;
+static size_t show_len = 0;
+static size_t show_size = 0;
+
+/* Append formatted text to show_buf.  Text is dropped if out of memory */
+static void show_append(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(show_buf ? show_buf + show_len : NULL,
+                        show_size - show_len, fmt, ap);
+    va_end(ap);
+    if (len < 0)
+        return;
+
+    if (show_len + len + 1 > show_size) {
+        size_t size = show_size ? show_size : 256;
+        while (size < show_len + len + 1)
+            size *= 2;
+        char *buf = realloc(show_buf, size);
+        if (!buf)
+            return;
+        show_buf = buf;
+        show_size = size;
+        va_start(ap, fmt);
+        vsnprintf(show_buf + show_len, show_size - show_len, fmt, ap);
+        va_end(ap);
+    }
+    show_len += len;
+}
+
+/* Entropy of the value of an element.  Values do not change once inserted,
+ * so it is computed once and cached with the allocation of the string.
+ */
+static double element_entropy(char *value)
+{
+    float *memo = block_memo(value);
+    if (memo && !isnan(*memo))
+        return *memo;
+
+    /* Rounded as cached, so that every show prints the same value */
+    float entropy = shannon_entropy((const uint8_t *) value, strlen(value));
+    if (memo)
+        *memo = entropy;
+    return entropy;
+}
+
 static bool q_show(int vlevel)
 {
-    bool ok = true;
-    if (verblevel < vlevel)
+    bool ends = ends_only;
+    ends_only = false;
+
+    /* report() would drop the line, so neither walk the queue nor format it */
+    if (vlevel > verblevel)
         return true;
 
+    bool ok = true;
+
     int cnt = 0;
     if (!current || !current->q) {
         report(vlevel, "l = NULL");
         return true;
     }
 
-    if (!is_circular()) {
+    /* Commands that relink the middle of the queue get the full check */
+    bool partial = ends && current->size > check_limit;
+    if (partial ? !ends_linked(BIG_LIST_SIZE) : !is_circular()) {
         report(vlevel, "ERROR:  Queue is not doubly circular");
         return false;
     }
 
-    report_noreturn(vlevel, "l = [");
+    /* Build the whole line, then report it at once */
+    show_len = 0;
+    show_append("l = [");
 
     struct list_head *ori = current->q;
     struct list_head *cur = current->q->next;
 
     if (exception_setup(true)) {
-        while (ok && ori != cur && cnt < current->size) {
+        while (ok && ori != cur && cnt < current->size &&
+               !(partial && cnt >= BIG_LIST_SIZE)) {
             element_t *e = list_entry(cur, element_t, list);
             if (cnt < BIG_LIST_SIZE) {
-                report_noreturn(vlevel, cnt == 0 ? "%s" : " %s", e->value);
-                if (show_entropy) {
-                    report_noreturn(
-                        vlevel, "(%3.2f%%)",
-                        shannon_entropy((const uint8_t *) e->value));
-                }
+                show_append(cnt == 0 ? "%s" : " %s", e->value);
+                if (show_entropy)
+                    show_append("(%3.2f%%)", element_entropy(e->value));
             }
             cnt++;
             cur = cur->next;
@@ -977,18 +1370,14 @@ static bool q_show(int vlevel)
     }
     exception_cancel();
 
-    if (!ok) {
-        report(vlevel, " ... ]");
+    /* Close the line in the buffer, so that it is reported as is */
+    bool complete = ok && !partial && cur == ori && cnt <= BIG_LIST_SIZE;
+    show_append(complete ? "]" : " ... ]");
+    report(vlevel, "%s", show_buf ? show_buf : "l = [ ... ]");
+    if (!ok)
         return false;
-    }
 
-    if (cur == ori) {
-        if (cnt <= BIG_LIST_SIZE)
-            report(vlevel, "]");
-        else
-            report(vlevel, " ... ]");
-    } else {
-        report(vlevel, " ... ]");
+    if (!partial && cur != ori) {
         report(vlevel, "ERROR:  Queue has more than %d elements",
                current->size);
         ok = false;
@@ -997,6 +1386,48 @@ static bool q_show(int vlevel)
     return ok;
 }
 
+/* Check every link of the current queue and its length, which q_show skips
+ * after insertions and removals at the ends of queues longer than
+ * check_limit.
+ */
+static bool do_verify(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    if (!current || !current->q) {
+        report(3, "Warning: Calling verify on null queue");
+        return true;
+    }
+
+    if (!is_circular()) {
+        report(1, "ERROR:  Queue is not doubly circular");
+        return false;
+    }
+
+    int cnt = 0;
+    struct list_head *cur;
+    list_for_each(cur, current->q) {
+        if (cur->next->prev != cur) {
+            report(1, "ERROR:  Element %d is not linked back by its successor",
+                   cnt);
+            return false;
+        }
+        cnt++;
+    }
+
+    if (cnt != current->size) {
+        report(1, "ERROR:  Queue has %d elements, expected %d", cnt,
+               current->size);
+        return false;
+    }
+
+    report(2, "Queue is consistent, size = %d", cnt);
+    return true;
+}
+
 static bool do_show(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -1010,6 +1441,512 @@ static bool do_show(int argc, char *argv[])
     return q_show(0);
 }
 
+/* Registers of the HyperLogLog sketch counting distinct values */
+#define HLL_BITS 12
+#define HLL_REGISTERS (1 << HLL_BITS)
+/* Elements sampled at an even stride to estimate the number of inversions */
+#define STATS_SAMPLES 512
+
+static uint64_t hash_string(const char *s, size_t *len)
+{
+    /* FNV-1a, then mixed so that the top bits are usable */
+    uint64_t h = 0xcbf29ce484222325;
+    const char *p = s;
+    for (; *p; p++)
+        h = (h ^ (uint8_t) *p) * 0x100000001b3;
+    *len = p - s;
+    return random_shuffle((uintptr_t) h);
+}
+
+static double hll_estimate(const uint8_t *reg)
+{
+    double sum = 0;
+    int zeros = 0;
+    for (int j = 0; j < HLL_REGISTERS; j++) {
+        sum += ldexp(1.0, -reg[j]);
+        zeros += !reg[j];
+    }
+    double m = HLL_REGISTERS;
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    /* Few distinct values: count the empty registers instead */
+    if (estimate <= 2.5 * m && zeros)
+        estimate = m * log(m / zeros);
+    return estimate;
+}
+
+/* Summarize the current queue in a single pass and in fixed memory: distinct
+ * values are estimated with a HyperLogLog sketch, and inversions from an
+ * evenly spaced sample of the elements.
+ */
+static bool do_stats(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    if (!current || !current->q) {
+        report(3, "Warning: Calling stats on null queue");
+        return true;
+    }
+
+    uint8_t reg[HLL_REGISTERS] = {0};
+    uint64_t bytes[256] = {0};
+    const char *sample[STATS_SAMPLES];
+    size_t n_samples = 0;
+    size_t stride = (current->size + STATS_SAMPLES - 1) / STATS_SAMPLES;
+    size_t cnt = 0, total_len = 0, descents = 0;
+    const char *min = NULL, *max = NULL, *prev = NULL;
+
+    error_check();
+    if (exception_setup(true)) {
+        struct list_head *cur = current->q->next;
+        while (cur != current->q && cnt < (size_t) current->size) {
+            const char *value = list_entry(cur, element_t, list)->value;
+            /* Fetch the next string while this one is being looked at */
+            if (cur->next != current->q)
+                __builtin_prefetch(
+                    list_entry(cur->next, element_t, list)->value);
+
+            size_t len;
+            uint64_t h = hash_string(value, &len);
+            uint8_t rank = __builtin_clzll((h << HLL_BITS) | 1) + 1;
+            if (rank > reg[h >> (64 - HLL_BITS)])
+                reg[h >> (64 - HLL_BITS)] = rank;
+
+            for (size_t i = 0; i < len; i++)
+                bytes[(uint8_t) value[i]]++;
+            total_len += len;
+
+            if (!min || strcmp(value, min) < 0)
+                min = value;
+            if (!max || strcmp(value, max) > 0)
+                max = value;
+            if (prev && strcmp(prev, value) > 0)
+                descents++;
+            if (cnt % stride == 0)
+                sample[n_samples++] = value;
+
+            prev = value;
+            cnt++;
+            cur = cur->next;
+        }
+
+        if (!cnt) {
+            report(1, "Queue is empty");
+        } else {
+            size_t inversions = 0;
+            for (size_t i = 0; i < n_samples; i++)
+                for (size_t j = i + 1; j < n_samples; j++)
+                    inversions += strcmp(sample[i], sample[j]) > 0;
+            double pairs = (double) cnt * (cnt - 1) / 2;
+            double inverted =
+                n_samples > 1
+                    ? inversions / ((double) n_samples * (n_samples - 1) / 2)
+                    : 0;
+
+            double entropy = 0;
+            for (int c = 0; c < 256; c++) {
+                if (bytes[c]) {
+                    double p = (double) bytes[c] / total_len;
+                    entropy -= p * log2(p);
+                }
+            }
+
+            double distinct = hll_estimate(reg);
+            if (distinct > cnt)
+                distinct = cnt;
+
+            report(1, "Elements: %zu", cnt);
+            report(1, "Length: %zu total, %.2f average", total_len,
+                   (double) total_len / cnt);
+            report(1, "Min: %.*s", string_length, min);
+            report(1, "Max: %.*s", string_length, max);
+            report(1, "Distinct: ~%.0f (%.1f%% duplicates)", distinct,
+                   100.0 * (cnt - distinct) / cnt);
+            report(1,
+                   "Sortedness: %zu of %zu adjacent pairs descend, "
+                   "~%.0f inversions (%.1f%% of pairs)",
+                   descents, cnt - 1, inverted * pairs, 100.0 * inverted);
+            report(1, "Entropy: %.2f%% over all bytes",
+                   total_len ? entropy * 100.0 / 8 : 0);
+        }
+    }
+    exception_cancel();
+
+    return !error_check();
+}
+
+/* Elements inserted or removed per timed run of an element operation */
+#define BENCH_BATCH 64
+/* Each queue length is measured for at least this many seconds */
+#define BENCH_MIN_TIME 0.01
+/* Lengths stop doubling once a single run takes longer than this */
+#define BENCH_MAX_TIME 0.1
+#define BENCH_MAX_SIZES 32
+
+/* Strings inserted by element operations, and elements removed by them */
+static char bench_strings[BENCH_BATCH][RANDSTR_SLOT];
+static element_t *bench_removed[BENCH_BATCH];
+
+static void bench_insert(struct list_head *q, bool tail)
+{
+    for (int i = 0; i < BENCH_BATCH; i++) {
+        if (tail)
+            q_insert_tail(q, bench_strings[i]);
+        else
+            q_insert_head(q, bench_strings[i]);
+    }
+}
+
+static void bench_remove(struct list_head *q, bool tail)
+{
+    for (int i = 0; i < BENCH_BATCH; i++)
+        bench_removed[i] =
+            tail ? q_remove_tail(q, NULL, 0) : q_remove_head(q, NULL, 0);
+}
+
+static void bench_release(void)
+{
+    for (int i = 0; i < BENCH_BATCH; i++) {
+        if (bench_removed[i])
+            q_release_element(bench_removed[i]);
+        bench_removed[i] = NULL;
+    }
+}
+
+static void bench_ih(struct list_head *q)
+{
+    bench_insert(q, false);
+}
+
+static void bench_it(struct list_head *q)
+{
+    bench_insert(q, true);
+}
+
+static void bench_rh(struct list_head *q)
+{
+    bench_remove(q, false);
+}
+
+static void bench_rt(struct list_head *q)
+{
+    bench_remove(q, true);
+}
+
+static void bench_undo_ih(struct list_head *q)
+{
+    bench_remove(q, false);
+    bench_release();
+}
+
+static void bench_undo_it(struct list_head *q)
+{
+    bench_remove(q, true);
+    bench_release();
+}
+
+static void bench_undo_rh(struct list_head *q)
+{
+    bench_release();
+    bench_insert(q, false);
+}
+
+static void bench_undo_rt(struct list_head *q)
+{
+    bench_release();
+    bench_insert(q, true);
+}
+
+static void bench_size(struct list_head *q)
+{
+    for (int i = 0; i < BENCH_BATCH; i++)
+        q_size(q);
+}
+
+static void bench_dm(struct list_head *q)
+{
+    q_delete_mid(q);
+}
+
+static void bench_undo_dm(struct list_head *q)
+{
+    q_insert_tail(q, bench_strings[0]);
+}
+
+static void bench_swap(struct list_head *q)
+{
+    q_swap(q);
+}
+
+static void bench_reverse(struct list_head *q)
+{
+    q_reverse(q);
+}
+
+static void bench_reverseK(struct list_head *q)
+{
+    q_reverseK(q, 4);
+}
+
+static void bench_sort(struct list_head *q)
+{
+    q_sort(q, descend);
+}
+
+static void bench_dedup(struct list_head *q)
+{
+    q_delete_dup(q);
+}
+
+static void bench_ascend(struct list_head *q)
+{
+    q_ascend(q);
+}
+
+static void bench_descend(struct list_head *q)
+{
+    q_descend(q);
+}
+
+/* An operation measured by the bench command */
+typedef struct {
+    const char *name;
+    int count;                         /* Operations per run */
+    void (*run)(struct list_head *q);  /* Timed */
+    void (*undo)(struct list_head *q); /* Restores the length, if needed */
+    bool rebuild; /* Fill the queue anew before every run */
+    bool sorted;  /* Sort the queue before every run */
+} bench_op_t;
+
+static const bench_op_t bench_ops[] = {
+    {"ih", BENCH_BATCH, bench_ih, bench_undo_ih, false, false},
+    {"it", BENCH_BATCH, bench_it, bench_undo_it, false, false},
+    {"rh", BENCH_BATCH, bench_rh, bench_undo_rh, false, false},
+    {"rt", BENCH_BATCH, bench_rt, bench_undo_rt, false, false},
+    {"size", BENCH_BATCH, bench_size, NULL, false, false},
+    {"dm", 1, bench_dm, bench_undo_dm, false, false},
+    {"swap", 1, bench_swap, NULL, false, false},
+    {"reverse", 1, bench_reverse, NULL, false, false},
+    {"reverseK", 1, bench_reverseK, NULL, false, false},
+    {"sort", 1, bench_sort, NULL, true, false},
+    {"dedup", 1, bench_dedup, NULL, true, true},
+    {"ascend", 1, bench_ascend, NULL, true, false},
+    {"descend", 1, bench_descend, NULL, true, false},
+};
+
+/* Growth models fitted to the measurements */
+static const char *const bench_models[] = {
+    "1", "log n", "n", "n log n", "n^2",
+};
+#define BENCH_MODELS (sizeof(bench_models) / sizeof(bench_models[0]))
+
+static double bench_model(size_t model, double n)
+{
+    switch (model) {
+    case 0:
+        return 1;
+    case 1:
+        return log2(n);
+    case 2:
+        return n;
+    case 3:
+        return n * log2(n);
+    default:
+        return n * n;
+    }
+}
+
+/* Fit t = c * f(n) by least squares on the relative error, so that the
+ * short queues weigh as much as the long ones.  Every model then has a
+ * single parameter, and the one with the lowest error fits best whatever
+ * lengths were measured.  Return the root mean square of the relative
+ * residuals.
+ */
+static double bench_fit(size_t model,
+                        const double *n,
+                        const double *t,
+                        int m,
+                        double *c)
+{
+    double sxy = 0, sxx = 0;
+    for (int i = 0; i < m; i++) {
+        double x = bench_model(model, n[i]) / t[i];
+        sxy += x;
+        sxx += x * x;
+    }
+    *c = sxy / sxx;
+
+    double residual = 0;
+    for (int i = 0; i < m; i++) {
+        double r = 1 - *c * bench_model(model, n[i]) / t[i];
+        residual += r * r;
+    }
+    return sqrt(residual / m);
+}
+
+/* Make q hold n random elements, sorted if asked to */
+static void bench_fill(struct list_head *q, int n, bool sorted)
+{
+    char buf[RANDSTR_BATCH][RANDSTR_SLOT];
+    randstr_gen_t gen;
+
+    while (!list_empty(q))
+        q_release_element(q_remove_head(q, NULL, 0));
+
+    init_rand_strings(&gen, DIST_UNIFORM, n);
+    for (int i = 0; i < n; i += RANDSTR_BATCH) {
+        int count = n - i < RANDSTR_BATCH ? n - i : RANDSTR_BATCH;
+        fill_rand_strings(&gen, buf[0], count);
+        for (int j = 0; j < count; j++)
+            q_insert_tail(q, buf[j]);
+    }
+    if (sorted)
+        q_sort(q, false);
+}
+
+/* Nanoseconds per operation of op on a queue of n elements, or a negative
+ * value if it failed.  *longest is raised to the longest single run.
+ */
+static double bench_measure(const bench_op_t *op,
+                            struct list_head *q,
+                            int n,
+                            double *longest)
+{
+    double elapsed = 0;
+    long runs = 0;
+
+    while (elapsed < BENCH_MIN_TIME) {
+        if (!runs || op->rebuild)
+            bench_fill(q, n, op->sorted);
+
+        bool done = false;
+        double t;
+        init_time(&t);
+        if (exception_setup(true)) {
+            op->run(q);
+            done = true;
+        }
+        exception_cancel();
+        double d = delta_time(&t);
+        if (!done || error_check())
+            return -1;
+
+        if (op->undo)
+            op->undo(q);
+        elapsed += d;
+        runs++;
+        if (d > *longest)
+            *longest = d;
+    }
+    return elapsed * 1e9 / ((double) runs * op->count);
+}
+
+/* Time an operation on queues of doubling length, fit the growth models and
+ * report the result as a JSON object.
+ */
+static bool bench_op(const bench_op_t *op, int max_size, bool last)
+{
+    double n[BENCH_MAX_SIZES], ns[BENCH_MAX_SIZES];
+    int m = 0;
+    double longest = 0;
+    bool ok = true;
+
+    struct list_head *q = q_new();
+    if (!q) {
+        report(1, "ERROR: Could not allocate a queue for bench");
+        return false;
+    }
+    for (int size = BENCH_BATCH;
+         size <= max_size && m < BENCH_MAX_SIZES && longest < BENCH_MAX_TIME;
+         size *= 2) {
+        double t = bench_measure(op, q, size, &longest);
+        if (t < 0) {
+            ok = false;
+            break;
+        }
+        n[m] = size;
+        ns[m++] = t;
+    }
+    /* A queue that failed may be in any state, so it is not freed */
+    if (ok) {
+        bench_release();
+        q_free(q);
+    }
+
+    size_t best = 0;
+    double coef = 0, best_residual = INFINITY;
+    for (size_t model = 0; m && model < BENCH_MODELS; model++) {
+        double c;
+        double residual = bench_fit(model, n, ns, m, &c);
+        if (residual < best_residual) {
+            best = model;
+            best_residual = residual;
+            coef = c;
+        }
+    }
+
+    report_noreturn(1, "  {\"op\": \"%s\", ", op->name);
+    if (ok)
+        report_noreturn(1,
+                        "\"complexity\": \"O(%s)\", \"coef\": %.3g, "
+                        "\"rms\": %.3f, ",
+                        bench_models[best], coef, best_residual);
+    else
+        report_noreturn(1, "\"error\": true, ");
+    report_noreturn(1, "\"samples\": [");
+    for (int i = 0; i < m; i++)
+        report_noreturn(1, "%s[%.0f, %.1f]", i ? ", " : "", n[i], ns[i]);
+    report(1, "]}%s", last ? "" : ",");
+    return ok;
+}
+
+static bool do_bench(int argc, char *argv[])
+{
+    if (argc > 3) {
+        report(1, "%s takes 0-2 arguments", argv[0]);
+        return false;
+    }
+
+    const char *name = argc > 1 ? argv[1] : "all";
+    int max_size = 1 << 16;
+    if (argc > 2 && (!get_int(argv[2], &max_size) || max_size < BENCH_BATCH)) {
+        report(1, "Invalid maximum queue length '%s'", argv[2]);
+        return false;
+    }
+
+    size_t first = 0, end = sizeof(bench_ops) / sizeof(bench_ops[0]);
+    if (strcmp(name, "all")) {
+        while (first < end && strcmp(name, bench_ops[first].name))
+            first++;
+        if (first == end) {
+            report(1, "Unknown operation '%s'", name);
+            return false;
+        }
+        end = first + 1;
+    }
+
+    /* Allocation failures would only measure the error paths, and checking
+     * every free against all allocated blocks would dominate the timing.
+     */
+    int saved_fail_probability = fail_probability;
+    fail_probability = 0;
+    set_cautious_mode(false);
+    for (int i = 0; i < BENCH_BATCH; i++)
+        fill_uniform(bench_strings[i]);
+
+    bool ok = true;
+    report(1, "[");
+    for (size_t i = first; i < end; i++)
+        ok = bench_op(&bench_ops[i], max_size, i + 1 == end) && ok;
+    report(1, "]");
+
+    set_cautious_mode(true);
+    fail_probability = saved_fail_probability;
+    return ok;
+}
+
 static bool do_prev(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -1056,6 +1993,19 @@ static bool do_next(int argc, char *argv[])
     return q_show(0);
 }
 
+/* Restart the generators whenever the seed is set, so that setting the same
+ * seed again replays the same workload.
+ */
+static void set_seed(int oldval)
+{
+    if (rand_seed) {
+        random_seed(rand_seed);
+        srand(rand_seed);
+    } else {
+        random_reseed();
+    }
+}
+
 static void console_init()
 {
     ADD_COMMAND(new, "Create new queue", "");
@@ -1064,12 +2014,14 @@ static void console_init()
     ADD_COMMAND(next, "Switch to next queue", "");
     ADD_COMMAND(ih,
                 "Insert string str at head of queue n times. Generate random "
-                "string(s) if str equals RAND. (default: n == 1)",
-                "str [n]");
+                "string(s) of distribution dist if str equals RAND. "
+                "(default: n == 1, dist == uniform)",
+                "str [n] [dist]");
     ADD_COMMAND(it,
                 "Insert string str at tail of queue n times. Generate random "
-                "string(s) if str equals RAND. (default: n == 1)",
-                "str [n]");
+                "string(s) of distribution dist if str equals RAND. "
+                "(default: n == 1, dist == uniform)",
+                "str [n] [dist]");
     ADD_COMMAND(
         rh,
         "Remove from head of queue. Optionally compare to expected value str",
@@ -1082,6 +2034,16 @@ static void console_init()
     ADD_COMMAND(sort, "Sort queue in ascending/descending order", "");
     ADD_COMMAND(size, "Compute queue size n times (default: n == 1)", "[n]");
     ADD_COMMAND(show, "Show queue contents", "");
+    ADD_COMMAND(bench,
+                "Time operation op, or all of them, on queues of doubling "
+                "length up to max and fit its complexity, in JSON "
+                "(default: op == all, max == 65536)",
+                "[op] [max]");
+    ADD_COMMAND(verify, "Check the links and length of queue", "");
+    ADD_COMMAND(stats,
+                "Show element count, lengths, distinct values, sortedness and "
+                "entropy of queue",
+                "");
     ADD_COMMAND(dm, "Delete middle node in queue", "");
     ADD_COMMAND(dedup, "Delete all nodes that have duplicate string", "");
     ADD_COMMAND(merge, "Merge all the queues into one sorted queue", "");
@@ -1104,11 +2066,33 @@ static void console_init()
               "Number of times allow queue operations to return false", NULL);
     add_param("descend", &descend,
               "Sort and merge queue in ascending/descending order", NULL);
+    add_param("workers", &dudect_workers,
+              "Number of processes measuring in simulation mode", NULL);
+    add_param("measures", &dudect_measures,
+              "Number of measurements per batch in simulation mode", NULL);
+    add_param("enough", &dudect_enough,
+              "Number of measurements needed in simulation mode", NULL);
+    add_param("tries", &dudect_tries,
+              "Number of attempts in simulation mode", NULL);
+    add_param("adaptive", &dudect_adaptive,
+              "Stop simulation as soon as the outcome is clear", NULL);
+    add_param("checklimit", &check_limit,
+              "Queue length above which only the ends are checked after "
+              "inserting or removing at an end",
+              NULL);
+    add_param("seed", &rand_seed,
+              "Seed of RAND strings and malloc failures (0: from the OS)",
+              set_seed);
 }
 
 /* Signal handlers */
 static void sigsegv_handler(int sig)
 {
+    /* Report output is buffered.  Flushing it is not async-signal-safe, but
+     * the process is about to abort anyway, and the output leading up to the
+     * fault is what makes it debuggable.
+     */
+    report_flush();
     /* Avoid possible non-reentrant signal function be used in signal handler */
     assert(write(1,
                  "Segmentation fault occurred.  You dereferenced a NULL or "
@@ -1153,6 +2137,10 @@ static bool q_quit(int argc, char *argv[])
     exception_cancel();
     set_cautious_mode(true);
 
+    free(show_buf);
+    show_buf = NULL;
+    show_len = show_size = 0;
+
     size_t bcnt = allocation_check();
     if (bcnt > 0) {
         report(1, "ERROR: Freed queue, but %lu blocks are still allocated",
@@ -1165,9 +2153,12 @@ static bool q_quit(int argc, char *argv[])
 
 static void usage(char *cmd)
 {
-    printf("Usage: %s [-h] [-f FILE][-v LEVEL][-l LOG\n", cmd);
+    printf("Usage: %s [-h] [-f FILE][-c OUT][-b FILE][-v LEVEL][-l LOG\n",
+           cmd);
     printf("\t-h         Print this information\n");
     printf("\t-f FILE   Read commands from FILE\n");
+    printf("\t-c OUT    Compile commands from -f FILE into OUT and exit\n");
+    printf("\t-b FILE   Replay commands from FILE compiled with -c\n");
     printf("\t-v LEVEL  Set verbosity level\n");
     printf("\t-l LOG    Echo results to LOG\n");
     exit(0);
@@ -1376,10 +2367,14 @@ int main(int argc, char *argv[])
     char *infile_name = NULL;
     char lbuf[BUFSIZE];
     char *logfile_name = NULL;
+    char cbuf[BUFSIZE];
+    char *compile_name = NULL;
+    char bbuf[BUFSIZE];
+    char *compiled_name = NULL;
     int level = 4;
     int c;
 
-    while ((c = getopt(argc, argv, "hv:f:l:")) != -1) {
+    while ((c = getopt(argc, argv, "hv:f:c:b:l:")) != -1) {
         switch (c) {
         case 'h':
             usage(argv[0]);
@@ -1389,6 +2384,16 @@ int main(int argc, char *argv[])
             buf[BUFSIZE - 1] = '\0';
             infile_name = buf;
             break;
+        case 'c':
+            strncpy(cbuf, optarg, BUFSIZE);
+            cbuf[BUFSIZE - 1] = '\0';
+            compile_name = cbuf;
+            break;
+        case 'b':
+            strncpy(bbuf, optarg, BUFSIZE);
+            bbuf[BUFSIZE - 1] = '\0';
+            compiled_name = bbuf;
+            break;
         case 'v': {
             char *endptr;
             errno = 0;
@@ -1437,8 +2442,16 @@ int main(int argc, char *argv[])
 
     add_quit_helper(q_quit);
 
+    if (compile_name) {
+        bool ok = compile_trace(infile_name, compile_name);
+        return !(finish_cmd() && ok);
+    }
+
     bool ok = true;
-    ok = ok && run_console(infile_name);
+    if (compiled_name)
+        ok = ok && run_compiled(compiled_name);
+    else
+        ok = ok && run_console(infile_name);
 
     /* Do finish_cmd() before check whether ok is true or false */
     ok = finish_cmd() && ok;
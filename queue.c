@@ -104,9 +104,9 @@ bool q_delete_mid(struct list_head *head)
         return false;
     if (list_is_singular(head)) {
         element_t *victim = list_first_entry(head, element_t, list);
+        list_del_init(head->next);
         free(victim->value);
         free(victim);
-        list_del_init(head->next);
         return true;
     }
     // 1 -> 2 -> 3 -> 4 -> 5 -> NULL
@@ -30,6 +30,9 @@
 
 #include "random.h"
 
+#include <stdbool.h>
+#include <string.h>
+
 #if defined(__linux__) || defined(__GNU__)
 /* We would need to include <linux/random.h>, but not every target has access
  * to the linux headers. We only need RNDGETENTCNT, so we instead inline it.
@@ -291,3 +294,72 @@ int randombytes(uint8_t *buf, size_t n)
 #error "randombytes(...) is not supported on this platform"
 #endif
 }
+
+/* Fast userspace generator for workloads: xoshiro256** by David Blackman and
+ * Sebastiano Vigna, see <https://prng.di.unimi.it/xoshiro256starstar.c>.
+ * It is seeded once from randombytes(), so generating random data does not
+ * take a system call per value.  It is not meant for cryptographic use.
+ */
+static uint64_t rng_state[4];
+static bool rng_seeded = false;
+
+static inline uint64_t rotl(const uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+void random_reseed(void)
+{
+    do {
+        randombytes((uint8_t *) rng_state, sizeof(rng_state));
+        /* The all-zero state is the one the generator cannot leave */
+    } while (!(rng_state[0] | rng_state[1] | rng_state[2] | rng_state[3]));
+    rng_seeded = true;
+}
+
+/* Derive the whole state from a single seed with splitmix64, so that the same
+ * seed always yields the same numbers.
+ */
+void random_seed(uint64_t seed)
+{
+    for (int i = 0; i < 4; i++) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        rng_state[i] = z ^ (z >> 31);
+    }
+    rng_seeded = true;
+}
+
+uint64_t random_u64(void)
+{
+    if (!rng_seeded)
+        random_reseed();
+
+    uint64_t *s = rng_state;
+    const uint64_t result = rotl(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+
+    return result;
+}
+
+void random_fill(void *buf, size_t n)
+{
+    uint8_t *p = buf;
+    for (; n >= sizeof(uint64_t); n -= sizeof(uint64_t)) {
+        uint64_t x = random_u64();
+        memcpy(p, &x, sizeof(x));
+        p += sizeof(x);
+    }
+    if (n) {
+        uint64_t x = random_u64();
+        memcpy(p, &x, n);
+    }
+}
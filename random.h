@@ -6,11 +6,18 @@
 
 extern int randombytes(uint8_t *buf, size_t len);
 
+/* Buffered generator for workloads, seeded from randombytes() on first use.
+ * Call random_reseed() in a forked child so that it does not repeat the
+ * numbers of its parent, or random_seed() to replay a sequence.
+ */
+void random_reseed(void);
+void random_seed(uint64_t seed);
+uint64_t random_u64(void);
+void random_fill(void *buf, size_t n);
+
 static inline uint8_t randombit(void)
 {
-    uint8_t ret = 0;
-    randombytes(&ret, 1);
-    return ret & 1;
+    return random_u64() & 1;
 }
 
 #if INTPTR_MAX == INT64_MAX
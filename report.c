@@ -18,6 +18,11 @@ static FILE *errfile = NULL;
 static FILE *verbfile = NULL;
 static FILE *logfile = NULL;
 
+/* Buffer size for the log file.  Reports are no longer flushed one by one;
+ * buffered output is written in batches, on report_flush, or at exit.
+ */
+#define LOG_BUFSIZE (64 * 1024)
+
 int verblevel = 0;
 static void init_files(FILE *efile, FILE *vfile)
 {
@@ -32,6 +37,7 @@ static volatile int ret = 0;
 /* Default fatal function */
 static void default_fatal_fun()
 {
+    report_flush();
     ret = write(STDOUT_FILENO, fail_buf, strlen(fail_buf) + 1);
     if (logfile)
         fputs(fail_buf, logfile);
@@ -47,8 +53,24 @@ void set_verblevel(int level)
 
 bool set_logfile(const char *file_name)
 {
+    if (logfile)
+        fclose(logfile);
     logfile = fopen(file_name, "w");
-    return logfile != NULL;
+    if (!logfile)
+        return false;
+    setvbuf(logfile, NULL, _IOFBF, LOG_BUFSIZE);
+    return true;
+}
+
+void report_flush()
+{
+    if (verbfile)
+        fflush(verbfile);
+    if (errfile && errfile != verbfile)
+        fflush(errfile);
+    if (logfile)
+        fflush(logfile);
+    web_flush();
 }
 
 void report_event(message_t msg, char *fmt, ...)
@@ -75,7 +97,6 @@ void report_event(message_t msg, char *fmt, ...)
     fprintf(errfile, "%s: ", msg_name);
     vfprintf(errfile, fmt, ap);
     fprintf(errfile, "\n");
-    fflush(errfile);
     va_end(ap);
 
     if (logfile) {
@@ -83,9 +104,7 @@ void report_event(message_t msg, char *fmt, ...)
         fprintf(logfile, "Error: ");
         vfprintf(logfile, fmt, ap);
         fprintf(logfile, "\n");
-        fflush(logfile);
         va_end(ap);
-        fclose(logfile);
     }
 
     if (fatal) {
@@ -97,65 +116,69 @@ void report_event(message_t msg, char *fmt, ...)
 
 #define BUF_SIZE 4096
 extern int web_connfd;
-void report(int level, char *fmt, ...)
+
+/* Format a message once, then copy it to every output sink.
+ * Messages too long for the stack buffer are formatted on the heap.
+ */
+static void report_vout(bool newline, const char *fmt, va_list ap)
 {
     if (!verbfile)
         init_files(stdout, stdout);
 
     char buffer[BUF_SIZE];
-    if (level <= verblevel) {
-        va_list ap;
-        va_start(ap, fmt);
-        vfprintf(verbfile, fmt, ap);
-        fprintf(verbfile, "\n");
-        fflush(verbfile);
-        va_end(ap);
-
-        if (logfile) {
-            va_start(ap, fmt);
-            vfprintf(logfile, fmt, ap);
-            fprintf(logfile, "\n");
-            fflush(logfile);
-            va_end(ap);
+    char *msg = buffer;
+    va_list aq;
+    va_copy(aq, ap);
+    /* Leave room for the return character */
+    int len = vsnprintf(buffer, BUF_SIZE - 1, fmt, ap);
+    if (len > BUF_SIZE - 2) {
+        msg = malloc(len + 2);
+        if (msg)
+            vsnprintf(msg, len + 1, fmt, aq);
+        else {
+            msg = buffer;
+            len = BUF_SIZE - 2;
         }
-        va_start(ap, fmt);
-        vsnprintf(buffer, BUF_SIZE, fmt, ap);
-        va_end(ap);
     }
-    if (web_connfd) {
-        int len = strlen(buffer);
-        buffer[len] = '\n';
-        buffer[len + 1] = '\0';
-        web_send(web_connfd, buffer);
+    va_end(aq);
+    if (len < 0)
+        return;
+
+    if (newline) {
+        msg[len++] = '\n';
+        msg[len] = '\0';
     }
+
+    fwrite(msg, 1, len, verbfile);
+    if (logfile)
+        fwrite(msg, 1, len, logfile);
+    if (web_connfd)
+        web_send(web_connfd, msg, len);
+
+    if (msg != buffer)
+        free(msg);
 }
 
-void report_noreturn(int level, char *fmt, ...)
+void report(int level, char *fmt, ...)
 {
-    if (!verbfile)
-        init_files(stdout, stdout);
+    if (level > verblevel)
+        return;
 
-    char buffer[BUF_SIZE];
-    if (level <= verblevel) {
-        va_list ap;
-        va_start(ap, fmt);
-        vfprintf(verbfile, fmt, ap);
-        fflush(verbfile);
-        va_end(ap);
+    va_list ap;
+    va_start(ap, fmt);
+    report_vout(true, fmt, ap);
+    va_end(ap);
+}
 
-        if (logfile) {
-            va_start(ap, fmt);
-            vfprintf(logfile, fmt, ap);
-            fflush(logfile);
-            va_end(ap);
-        }
-        va_start(ap, fmt);
-        vsnprintf(buffer, BUF_SIZE, fmt, ap);
-        va_end(ap);
-    }
+void report_noreturn(int level, char *fmt, ...)
+{
+    if (level > verblevel)
+        return;
 
-    if (web_connfd)
-        web_send(web_connfd, buffer);
+    va_list ap;
+    va_start(ap, fmt);
+    report_vout(false, fmt, ap);
+    va_end(ap);
 }
 
 /* Functions denoting failures */
@@ -167,6 +190,7 @@ static void fail_fun(const char *format, const char *msg)
     /* Tack on return */
     fail_buf[strlen(fail_buf)] = '\n';
     /* Use write to avoid any buffering issues */
+    report_flush();
     ret = write(STDOUT_FILENO, fail_buf, strlen(fail_buf) + 1);
 
     if (logfile) {
@@ -14,6 +14,9 @@ typedef enum { MSG_WARN, MSG_ERROR, MSG_FATAL, N_MSG } message_t;
 
 bool set_logfile(const char *file_name);
 
+/* Write out any buffered report output */
+void report_flush();
+
 extern int verblevel;
 void set_verblevel(int level);
 
@@ -2,32 +2,87 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "shannon_entropy.h"
+
 /* Precalculated log2 realization */
 #include "log2_lshift16.h"
 
 /* Shannon full integer entropy calculation */
 #define BUCKET_SIZE (1 << 8)
 
-double shannon_entropy(const uint8_t *s)
+/* Inputs shorter than this are counted in a byte-wide histogram, which is
+ * then read back in the order of the input rather than bucket by bucket.
+ */
+#define SHORT_INPUT (1 << 8)
+
+/* Longer inputs spread their counts over several histograms, so that runs of
+ * one byte do not wait on each other through the same counter.
+ */
+#define N_HISTOGRAMS 4
+
+static inline uint64_t entropy_term(uint64_t p, uint64_t scale)
 {
-    assert(s);
-    const uint64_t count = strlen((char *) s);
+    p *= scale;
+    return -p * log2_lshift16(p);
+}
+
+static uint64_t short_entropy_sum(const uint8_t *s, size_t count)
+{
+    const uint64_t scale = LOG2_ARG_SHIFT / count;
     uint64_t entropy_sum = 0;
-    const uint64_t entropy_max = 8 * LOG2_RET_SHIFT;
 
-    uint32_t bucket[BUCKET_SIZE];
-    memset(&bucket, 0, sizeof(bucket));
+    uint8_t bucket[BUCKET_SIZE];
+    memset(bucket, 0, sizeof(bucket));
 
-    for (uint32_t i = 0; i < count; i++)
+    for (size_t i = 0; i < count; i++)
         bucket[s[i]]++;
 
-    for (uint32_t i = 0; i < BUCKET_SIZE; i++) {
-        if (bucket[i]) {
-            uint64_t p = bucket[i];
-            p *= LOG2_ARG_SHIFT / count;
-            entropy_sum += -p * log2_lshift16(p);
+    /* Add the term of each byte value at its first occurrence */
+    for (size_t i = 0; i < count; i++) {
+        if (bucket[s[i]]) {
+            entropy_sum += entropy_term(bucket[s[i]], scale);
+            bucket[s[i]] = 0;
         }
     }
+    return entropy_sum;
+}
+
+static uint64_t long_entropy_sum(const uint8_t *s, size_t count)
+{
+    const uint64_t scale = LOG2_ARG_SHIFT / count;
+    uint64_t entropy_sum = 0;
+
+    uint32_t bucket[N_HISTOGRAMS][BUCKET_SIZE];
+    memset(bucket, 0, sizeof(bucket));
+
+    size_t i = 0;
+    for (; i + N_HISTOGRAMS <= count; i += N_HISTOGRAMS) {
+        bucket[0][s[i]]++;
+        bucket[1][s[i + 1]]++;
+        bucket[2][s[i + 2]]++;
+        bucket[3][s[i + 3]]++;
+    }
+    for (; i < count; i++)
+        bucket[0][s[i]]++;
+
+    for (uint32_t j = 0; j < BUCKET_SIZE; j++) {
+        uint64_t p = (uint64_t) bucket[0][j] + bucket[1][j] + bucket[2][j] +
+                     bucket[3][j];
+        if (p)
+            entropy_sum += entropy_term(p, scale);
+    }
+    return entropy_sum;
+}
+
+double shannon_entropy(const uint8_t *s, size_t len)
+{
+    assert(s);
+    const uint64_t entropy_max = 8 * LOG2_RET_SHIFT;
+    if (!len)
+        return 0;
+
+    uint64_t entropy_sum = len < SHORT_INPUT ? short_entropy_sum(s, len)
+                                             : long_entropy_sum(s, len);
 
     entropy_sum /= LOG2_ARG_SHIFT;
     return entropy_sum * 100.0 / entropy_max;
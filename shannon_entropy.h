@@ -0,0 +1,12 @@
+#ifndef LAB0_SHANNON_ENTROPY_H
+#define LAB0_SHANNON_ENTROPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Entropy of the first len bytes of s, as a percentage of the 8 bits per
+ * byte an evenly distributed input would carry.
+ */
+double shannon_entropy(const uint8_t *s, size_t len);
+
+#endif /* LAB0_SHANNON_ENTROPY_H */
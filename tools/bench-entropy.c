@@ -0,0 +1,167 @@
+/* Check log2_lshift16() against its floating point definition for every
+ * argument up to 2^20, and shannon_entropy() against the plain
+ * single-histogram calculation.  Then measure both.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "log2_lshift16.h"
+#include "shannon_entropy.h"
+
+#define BUCKET_SIZE (1 << 8)
+#define TOTAL_BYTES (64 << 20)
+#define LOG2_CHECKED (1 << 20)
+#define LOG2_CALLS (1 << 24)
+
+/* The calculation shannon_entropy() replaces */
+static double reference_entropy(const uint8_t *s, size_t count)
+{
+    uint64_t entropy_sum = 0;
+    const uint64_t entropy_max = 8 * LOG2_RET_SHIFT;
+
+    uint32_t bucket[BUCKET_SIZE];
+    memset(&bucket, 0, sizeof(bucket));
+
+    for (uint32_t i = 0; i < count; i++)
+        bucket[s[i]]++;
+
+    for (uint32_t i = 0; i < BUCKET_SIZE; i++) {
+        if (bucket[i]) {
+            uint64_t p = bucket[i];
+            p *= LOG2_ARG_SHIFT / count;
+            entropy_sum += -p * log2_lshift16(p);
+        }
+    }
+
+    entropy_sum /= LOG2_ARG_SHIFT;
+    return entropy_sum * 100.0 / entropy_max;
+}
+
+static int reference_log2(uint64_t x)
+{
+    int r = (int) (log2(x + 0.5) * LOG2_RET_SHIFT - 16 * LOG2_RET_SHIFT);
+    return r < 0 ? r : 0;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int check_log2(void)
+{
+    static const uint64_t large[] = {UINT32_MAX, UINT32_MAX + 1ULL, UINT64_MAX};
+
+    for (uint64_t x = 0; x <= LOG2_CHECKED; x++) {
+        if (log2_lshift16(x) != reference_log2(x)) {
+            fprintf(stderr, "log2_lshift16(%lu) is %d, expected %d\n",
+                    (unsigned long) x, log2_lshift16(x), reference_log2(x));
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < sizeof(large) / sizeof(large[0]); i++) {
+        if (log2_lshift16(large[i]) != 0) {
+            fprintf(stderr, "log2_lshift16(%lu) is not 0\n",
+                    (unsigned long) large[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Time log2_lshift16() on arguments in random order, as the entropy
+ * calculation sees them, so that a branchy version pays its mispredictions.
+ */
+static void measure_log2(void)
+{
+    uint32_t *args = malloc(LOG2_CALLS * sizeof(uint32_t));
+    if (!args)
+        return;
+    srand(1);
+    for (size_t i = 0; i < LOG2_CALLS; i++)
+        args[i] = rand() % (LOG2_ARG_SHIFT + 1);
+
+    int64_t sum = 0;
+    double start = now();
+    for (size_t i = 0; i < LOG2_CALLS; i++)
+        sum += log2_lshift16(args[i]);
+    double table = (now() - start) * 1e9 / LOG2_CALLS;
+
+    start = now();
+    for (size_t i = 0; i < LOG2_CALLS; i++)
+        sum -= reference_log2(args[i]);
+    double libm = (now() - start) * 1e9 / LOG2_CALLS;
+
+    /* The two loops cancel out */
+    assert(sum == 0);
+    printf("log2_lshift16 %.2fns, libm log2 %.2fns per call\n\n", table,
+           libm);
+    free(args);
+}
+
+/* Nanoseconds per call of f over all inputs of length len in buf */
+static double measure(double (*f)(const uint8_t *, size_t),
+                      const uint8_t *buf,
+                      size_t len,
+                      double *sum)
+{
+    size_t n = TOTAL_BYTES / len;
+    double start = now();
+    for (size_t i = 0; i < n; i++)
+        *sum += f(buf + (i % 64) * len, len);
+    return (now() - start) * 1e9 / n;
+}
+
+int main(void)
+{
+    static const size_t lengths[] = {8, 16, 64, 256, 4096, 65536};
+    const size_t max_len = 65536;
+
+    if (check_log2())
+        return 1;
+    measure_log2();
+
+    /* 64 inputs of each length, from a small and a full alphabet */
+    uint8_t *buf = malloc(64 * max_len);
+    if (!buf) {
+        perror("malloc");
+        return 1;
+    }
+
+    printf("%8s %8s %12s %12s\n", "length", "alphabet", "reference",
+           "shannon");
+    for (int alphabet = 4; alphabet <= 256; alphabet *= 64) {
+        srand(1);
+        for (size_t i = 0; i < 64 * max_len; i++)
+            buf[i] = 'a' + rand() % alphabet;
+
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            size_t len = lengths[l];
+            for (size_t i = 0; i < 64; i++) {
+                const uint8_t *s = buf + i * len;
+                if (shannon_entropy(s, len) != reference_entropy(s, len)) {
+                    fprintf(stderr, "Mismatch at length %zu\n", len);
+                    return 1;
+                }
+            }
+
+            double sum = 0;
+            double ref = measure(reference_entropy, buf, len, &sum);
+            double cur = measure(shannon_entropy, buf, len, &sum);
+            printf("%8zu %8d %10.1fns %10.1fns\n", len, alphabet, ref, cur);
+            /* Keep the calls from being optimized away */
+            assert(sum >= 0);
+        }
+    }
+
+    free(buf);
+    return 0;
+}
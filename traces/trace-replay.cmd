@@ -0,0 +1,25 @@
+# Commands for make check to run both as text and compiled with -c, then
+# replayed with -b, which has to give the same output
+option seed 11
+option checklimit 16
+new
+ih dolphin
+ih bear 2
+it gerbil
+it RAND 20 zipf
+size 3
+rh
+rt
+reverseK 3
+swap
+dm
+sort
+dedup
+new
+it RAND 5 sorted
+prev
+merge
+stats
+verify
+free
+quit
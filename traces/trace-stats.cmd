@@ -0,0 +1,21 @@
+# Demonstration of the stats command, which summarizes a queue in one pass
+# Empty queue
+new
+stats
+# Duplicates and descending pairs show up in the summary
+it gerbil
+it bear
+it meerkat
+it bear
+stats
+# Once sorted, no adjacent pair descends
+sort
+stats
+# Random strings with a fixed seed give the same summary on every run
+option seed 7
+free
+new
+it RAND 1000 few
+stats
+free
+quit
@@ -0,0 +1,28 @@
+# Demonstration of how qtest checks the links of long queues
+# Queues longer than checklimit only have their ends checked after
+# insertions and removals at either end
+option checklimit 8
+new
+ih dolphin
+ih bear
+ih gerbil
+it meerkat
+it bear
+it vulture
+it ant
+it zebra
+it yak
+it cat
+# Commands that relink the middle of the queue are always checked in full
+reverse
+sort
+rh ant
+rt zebra
+# verify checks every link and the length, whatever checklimit says
+verify
+free
+# An empty queue is consistent too
+new
+verify
+free
+quit
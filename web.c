@@ -4,16 +4,25 @@
 
 #include <arpa/inet.h> /* inet_ntoa */
 #include <errno.h>
+#include <fcntl.h>
 #include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h> /* strncasecmp */
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include "web.h"
+
 #define LISTENQ 1024 /* second argument to listen() */
-#define MAXLINE 1024 /* max length of a line */
-#define BUFSIZE 1024
+#define REQ_BUFSIZE 8192 /* max length of a request line and its headers */
+#define OUT_FLUSH_SIZE (64 * 1024) /* send buffered output once this large */
+#define UNSENT_LIMIT (1024 * 1024) /* hold requests while this much is unsent */
 
 #ifndef DEFAULT_PORT
 #define DEFAULT_PORT 9999 /* use this port if none given as arg to main() */
@@ -25,61 +34,64 @@
 
 static int server_fd;
 
-typedef struct {
-    int fd;            /* descriptor for this buf */
-    int count;         /* unread byte in this buf */
-    char *bufptr;      /* next unread byte in this buf */
-    char buf[BUFSIZE]; /* internal buffer */
-} rio_t;
+/* Descriptor of the connection whose command is being executed, defined by
+ * the console.  Reports are copied to it while it is nonzero.
+ */
+extern int web_connfd;
 
+/* State of one client connection.  Requests are read without blocking into
+ * buf, so a connection may hold several pipelined requests at once.
+ */
 typedef struct {
-    char filename[512];
-    off_t offset; /* for support Range */
-    size_t end;
-} http_request_t;
-
-static void rio_readinitb(rio_t *rp, int fd)
-{
-    rp->fd = fd;
-    rp->count = 0;
-    rp->bufptr = rp->buf;
-}
-
-/* This is a wrapper for the Unix read() function that transfers min(n, count)
- * bytes from an internal buffer to a user buffer, where n is the number of
- * bytes requested by the user and count is the number of unread bytes in the
- * internal buffer. On entry, rio_read() refills the internal buffer via a call
- * to read() if the internal buffer is empty.
+    int fd;
+    size_t start;          /* offset of the first unparsed request in buf */
+    size_t len;            /* bytes in buf */
+    size_t scanned;        /* bytes after start searched for end of request */
+    size_t body_left;      /* bytes of the current request body not consumed */
+    bool batch;            /* body holds commands answered by one response */
+    bool chunked;          /* response to current request uses chunks */
+    bool keep_alive;       /* keep connection once current request is done */
+    bool eof;              /* client has finished sending */
+    bool closing;          /* close once the unsent output is gone */
+    bool broken;           /* output was lost, drop the connection */
+    const char *header;    /* response header not sent yet */
+    char *out;             /* response output not sent yet */
+    size_t out_len, out_size;
+    char *unsent; /* output the socket did not take, from unsent_off */
+    size_t unsent_off, unsent_len, unsent_size;
+    char buf[REQ_BUFSIZE]; /* unparsed request bytes */
+} web_conn_t;
+
+static web_conn_t **conns = NULL;
+static int n_conns = 0;
+static int conns_cap = 0;
+
+/* Descriptors polled by web_eventmux: stdin, the server, then connections */
+static struct pollfd *pfds = NULL;
+static int pfds_cap = 0;
+
+/* Connection served by the command currently being executed */
+static web_conn_t *busy_conn = NULL;
+
+/* Next connection to look at, so that clients are served round-robin */
+static int next_conn = 0;
+
+/* A parsed request.  The URI points into the connection buffer and is only
+ * valid until the connection is read again.
  */
-/* $begin rio_read */
-static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n)
-{
-    int cnt;
-    while (rp->count <= 0) { /* refill if buf is empty */
-        rp->count = read(rp->fd, rp->buf, sizeof(rp->buf));
-        if (rp->count < 0) {
-            if (errno != EINTR) /* interrupted by sig handler return */
-                return -1;
-        } else if (rp->count == 0) { /* EOF */
-            return 0;
-        } else
-            rp->bufptr = rp->buf; /* reset buffer ptr */
-    }
-
-    /* Copy min(n, rp->count) bytes from internal buf to user buf */
-    cnt = n;
-    if (rp->count < n)
-        cnt = rp->count;
-    memcpy(usrbuf, rp->bufptr, cnt);
-    rp->bufptr += cnt;
-    rp->count -= cnt;
-    return cnt;
-}
+typedef struct {
+    char *uri;
+    size_t uri_len;
+    size_t content_length;
+    bool batch; /* POST: run the commands in the body, one per line */
+    bool keep_alive;
+    bool chunked;
+} http_request_t;
 
-static ssize_t writen(int fd, void *usrbuf, size_t n)
+static ssize_t writen(int fd, const void *usrbuf, size_t n)
 {
     size_t nleft = n;
-    char *bufp = usrbuf;
+    const char *bufp = usrbuf;
 
     while (nleft > 0) {
         ssize_t nwritten = write(fd, bufp, nleft);
@@ -95,32 +107,174 @@ static ssize_t writen(int fd, void *usrbuf, size_t n)
     return n;
 }
 
-/* robustly read a text line (buffered) */
-static ssize_t rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
+static web_conn_t *find_conn(int fd)
 {
-    char c, *bufp = usrbuf;
-
-    int n;
-    for (n = 1; n < maxlen; n++) {
-        int rc;
-        if ((rc = rio_read(rp, &c, 1)) == 1) {
-            *bufp++ = c;
-            if (c == '\n')
-                break;
-        } else if (rc == 0) {
-            if (n == 1)
-                return 0; /* EOF, no data read */
-            break;        /* EOF, some data was read */
-        } else
-            return -1; /* error */
+    if (busy_conn && busy_conn->fd == fd)
+        return busy_conn;
+    for (int i = 0; i < n_conns; i++) {
+        if (conns[i]->fd == fd)
+            return conns[i];
     }
-    *bufp = 0;
-    return n;
+    return NULL;
+}
+
+static size_t unsent(const web_conn_t *c)
+{
+    return c->unsent_len - c->unsent_off;
+}
+
+/* Keep n bytes of buf to be sent once the socket of c is writable */
+static void keep_unsent(web_conn_t *c, const void *buf, size_t n)
+{
+    if (c->unsent_off && c->unsent_len + n > c->unsent_size) {
+        c->unsent_len -= c->unsent_off;
+        memmove(c->unsent, c->unsent + c->unsent_off, c->unsent_len);
+        c->unsent_off = 0;
+    }
+    if (c->unsent_len + n > c->unsent_size) {
+        size_t size = c->unsent_size ? c->unsent_size : 4096;
+        while (size < c->unsent_len + n)
+            size *= 2;
+        char *p = realloc(c->unsent, size);
+        if (!p) {
+            c->broken = true;
+            return;
+        }
+        c->unsent = p;
+        c->unsent_size = size;
+    }
+    memcpy(c->unsent + c->unsent_len, buf, n);
+    c->unsent_len += n;
 }
 
-void web_send(int out_fd, char *buf)
+/* Send as much of the output kept for c as its socket takes now */
+static void send_unsent(web_conn_t *c)
 {
-    writen(out_fd, buf, strlen(buf));
+    while (unsent(c)) {
+        ssize_t n = write(c->fd, c->unsent + c->unsent_off, unsent(c));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                c->broken = true;
+            return;
+        }
+        c->unsent_off += n;
+    }
+    c->unsent_off = c->unsent_len = 0;
+}
+
+/* Send the cnt buffers in iov on c without waiting.  What the socket does not
+ * take now is kept, after any output kept before, and sent by web_eventmux
+ * once the socket is writable.
+ */
+static void send_iov(web_conn_t *c, struct iovec *iov, int cnt)
+{
+    if (c->broken)
+        return;
+
+    if (!unsent(c)) {
+        ssize_t n;
+        do {
+            n = writev(c->fd, iov, cnt);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                c->broken = true;
+                return;
+            }
+            n = 0;
+        }
+        /* Skip what has been written */
+        while (cnt > 0 && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+
+    for (int i = 0; i < cnt; i++)
+        keep_unsent(c, iov[i].iov_base, iov[i].iov_len);
+}
+
+/* Send the pending header and buffered output of c, followed by len bytes of
+ * buf, with a single writev.  The output is sent as one chunk when the
+ * response is chunked, and the response is terminated if last is set.
+ */
+static void flush_output(web_conn_t *c, const char *buf, size_t len, bool last)
+{
+    struct iovec iov[6];
+    int cnt = 0;
+    char size[32];
+    size_t total = c->out_len + len;
+
+#define ADD_IOV(base, n)                     \
+    do {                                     \
+        iov[cnt].iov_base = (void *) (base); \
+        iov[cnt].iov_len = (n);              \
+        if (iov[cnt].iov_len)                \
+            cnt++;                           \
+    } while (0)
+
+    if (c->header)
+        ADD_IOV(c->header, strlen(c->header));
+    if (total && c->chunked)
+        ADD_IOV(size, snprintf(size, sizeof(size), "%zx\r\n", total));
+    ADD_IOV(c->out, c->out_len);
+    ADD_IOV(buf, len);
+    if (total && c->chunked)
+        ADD_IOV("\r\n", 2);
+    if (last && c->chunked)
+        ADD_IOV("0\r\n\r\n", 5);
+#undef ADD_IOV
+
+    if (cnt)
+        send_iov(c, iov, cnt);
+    c->header = NULL;
+    c->out_len = 0;
+}
+
+/* Append len bytes of buf to the response on out_fd.  Output is buffered
+ * until the command completes or enough of it has piled up.
+ */
+void web_send(int out_fd, const char *buf, size_t len)
+{
+    web_conn_t *c = find_conn(out_fd);
+    if (!c) {
+        writen(out_fd, buf, len);
+        return;
+    }
+    if (!len)
+        return;
+
+    if (c->out_len + len > c->out_size && c->out_len + len < OUT_FLUSH_SIZE) {
+        size_t size = c->out_size ? c->out_size : 4096;
+        while (size < c->out_len + len)
+            size *= 2;
+        char *out = realloc(c->out, size);
+        if (out) {
+            c->out = out;
+            c->out_size = size;
+        }
+    }
+    if (c->out_len + len > c->out_size) {
+        /* Large payloads are sent straight from the caller's buffer */
+        flush_output(c, buf, len, false);
+        return;
+    }
+    memcpy(c->out + c->out_len, buf, len);
+    c->out_len += len;
+}
+
+/* Send the output buffered for the command being executed */
+void web_flush()
+{
+    if (busy_conn)
+        flush_output(busy_conn, NULL, 0, false);
 }
 
 int web_open(int port)
@@ -156,116 +310,505 @@ int web_open(int port)
     if (listen(listenfd, LISTENQ) < 0)
         return -1;
 
+    /* Never block in accept(), and don't die when a client goes away while
+     * we are writing to it.
+     */
+    fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK);
+    signal(SIGPIPE, SIG_IGN);
+
     server_fd = listenfd;
 
     return listenfd;
 }
 
-static void url_decode(char *src, char *dest, int max)
+static inline int hex_value(char c)
 {
-    char *p = src;
-    char code[3] = {0};
-    while (*p && --max) {
-        if (*p == '%') {
-            memcpy(code, ++p, 2);
-            *dest++ = (char) strtoul(code, NULL, 16);
-            p += 2;
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20; /* lower case */
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+/* Decode %XX escapes of the len bytes at s in place, returning new length */
+static size_t url_decode(char *s, size_t len)
+{
+    char *p = memchr(s, '%', len);
+    if (!p)
+        return len;
+
+    char *dest = p, *end = s + len;
+    while (p < end) {
+        int hi, lo;
+        if (*p == '%' && end - p > 2 && (hi = hex_value(p[1])) >= 0 &&
+            (lo = hex_value(p[2])) >= 0) {
+            *dest++ = (char) (hi << 4 | lo);
+            p += 3;
         } else {
             *dest++ = *p++;
         }
     }
-    *dest = '\0';
+    return dest - s;
 }
 
-static void parse_request(int fd, http_request_t *req)
+/* Find end of the first request in c->buf, or NULL if it is incomplete.
+ * Bytes already searched by an earlier call are not looked at again.
+ */
+static char *request_end(web_conn_t *c)
 {
-    rio_t rio;
-    char buf[MAXLINE], method[MAXLINE], uri[MAXLINE];
-    req->offset = 0;
-    req->end = 0; /* default */
-
-    rio_readinitb(&rio, fd);
-    rio_readlineb(&rio, buf, MAXLINE);
-    sscanf(buf, "%1023s %1023s", method, uri); /* version is not cared */
-    /* read all */
-    while (buf[0] != '\n' && buf[1] != '\n') { /* \n || \r\n */
-        rio_readlineb(&rio, buf, MAXLINE);
-        if (buf[0] == 'R' && buf[1] == 'a' && buf[2] == 'n') {
-            sscanf(buf, "Range: bytes=%lu-%lu", (unsigned long *) &req->offset,
-                   (unsigned long *) &req->end);
-            /* Range: [start, end] */
-            if (req->end != 0)
-                req->end++;
+    char *start = c->buf + c->start, *end = c->buf + c->len;
+    char *p = start + c->scanned, *nl;
+    while ((nl = memchr(p, '\n', end - p))) {
+        char *q = nl + 1;
+        if (q < end && *q == '\r')
+            q++;
+        if (q == end)
+            break; /* the next read decides whether the line is blank */
+        if (*q == '\n')
+            return q + 1;
+        p = nl + 1;
+    }
+    c->scanned = p - start;
+    return NULL;
+}
+
+/* Parse the first complete request in c->buf without copying it, removing it
+ * from the buffer.  Return false if no complete request has been received.
+ */
+static bool parse_request(web_conn_t *c, http_request_t *req)
+{
+    /* Skip the body of a previous request that was not a batch */
+    if (c->body_left) {
+        size_t n = c->len - c->start;
+        if (n > c->body_left)
+            n = c->body_left;
+        c->start += n;
+        c->body_left -= n;
+        if (c->start == c->len)
+            c->start = c->len = 0;
+        if (c->body_left)
+            return false;
+    }
+
+    char *end = request_end(c);
+    if (!end)
+        return false;
+
+    /* Request line: method, URI and optional version separated by spaces */
+    char *line = c->buf + c->start;
+    char *eol = memchr(line, '\n', end - line);
+    char *line_end = eol > line && eol[-1] == '\r' ? eol - 1 : eol;
+    char *uri = memchr(line, ' ', line_end - line);
+    req->batch = uri == line + 4 && !memcmp(line, "POST", 4);
+    uri = uri ? uri + 1 : line_end;
+    char *uri_end = memchr(uri, ' ', line_end - uri);
+    char *version = uri_end ? uri_end + 1 : line_end;
+    if (!uri_end)
+        uri_end = line_end;
+    size_t version_len = line_end - version;
+    req->chunked =
+        version_len && !(version_len == 8 && !memcmp(version, "HTTP/1.0", 8));
+    req->content_length = 0;
+    bool want_keep_alive = req->chunked;
+
+    /* Look for headers giving the body length or overriding the default
+     * connection handling.
+     */
+    for (line = eol + 1; line < end; line = eol + 1) {
+        eol = memchr(line, '\n', end - line);
+        if (eol - line > 15 && !strncasecmp(line, "Content-Length:", 15)) {
+            req->content_length = strtoul(line + 15, NULL, 10);
+            continue;
         }
+        if (eol - line < 11 || strncasecmp(line, "Connection:", 11))
+            continue;
+        char *value = line + 11;
+        while (*value == ' ')
+            value++;
+        if (!strncasecmp(value, "close", 5))
+            want_keep_alive = false;
+        else if (!strncasecmp(value, "keep-alive", 10))
+            want_keep_alive = true;
     }
-    char *filename = uri;
-    if (uri[0] == '/') {
-        filename = uri + 1;
-        int length = strlen(filename);
-        if (length == 0) {
-            filename = ".";
-        } else {
-            for (int i = 0; i < length; ++i) {
-                if (filename[i] == '?') {
-                    filename[i] = '\0';
-                    break;
-                }
-            }
+    /* Only a chunked response tells the client where it ends.  The HTTP/1.0
+     * response has no Content-Length, so its end is marked by closing the
+     * connection, whatever the client asked for.
+     */
+    req->keep_alive = req->chunked && want_keep_alive;
+
+    if (uri < uri_end && *uri == '/') {
+        uri++;
+        char *query = memchr(uri, '?', uri_end - uri);
+        if (query)
+            uri_end = query;
+    }
+    req->uri = uri;
+    req->uri_len = url_decode(uri, uri_end - uri);
+    if (!req->uri_len) {
+        req->uri = ".";
+        req->uri_len = 1;
+    }
+
+    /* Drop the request from the buffer, keeping any pipelined ones */
+    c->start = end - c->buf;
+    c->scanned = 0;
+    if (c->start == c->len)
+        c->start = c->len = 0;
+    return true;
+}
+
+static void add_conn(int fd)
+{
+    if (n_conns == conns_cap) {
+        int cap = conns_cap ? conns_cap * 2 : 16;
+        web_conn_t **nc = realloc(conns, cap * sizeof(web_conn_t *));
+        if (!nc) {
+            close(fd);
+            return;
         }
+        conns = nc;
+        conns_cap = cap;
     }
-    url_decode(filename, req->filename, MAXLINE);
+
+    web_conn_t *c = malloc(sizeof(web_conn_t));
+    if (!c) {
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    c->fd = fd;
+    c->start = c->len = c->scanned = 0;
+    c->body_left = 0;
+    c->batch = false;
+    c->chunked = false;
+    c->keep_alive = true;
+    c->eof = false;
+    c->closing = false;
+    c->broken = false;
+    c->header = NULL;
+    c->out = NULL;
+    c->out_len = c->out_size = 0;
+    c->unsent = NULL;
+    c->unsent_off = c->unsent_len = c->unsent_size = 0;
+    conns[n_conns++] = c;
+}
+
+/* Close connection i now, moving the last connection into its place */
+static void drop_conn(int i)
+{
+    web_conn_t *c = conns[i];
+    if (c == busy_conn)
+        busy_conn = NULL;
+    close(c->fd);
+    free(c->out);
+    free(c->unsent);
+    free(c);
+    conns[i] = conns[--n_conns];
 }
 
-char *web_recv(int fd, struct sockaddr_in *clientaddr)
+/* Close connection i once the output kept for it has been sent */
+static void close_conn(int i)
 {
-    http_request_t req;
-    parse_request(fd, &req);
-
-    char *p = req.filename;
-    /* Change '/' to ' ' */
-    while (*p) {
-        ++p;
-        if (*p == '/')
-            *p = ' ';
+    web_conn_t *c = conns[i];
+    if (unsent(c) && !c->broken) {
+        c->closing = true;
+        return;
     }
-    char *ret = malloc(strlen(req.filename) + 1);
-    strncpy(ret, req.filename, strlen(req.filename) + 1);
+    drop_conn(i);
+}
 
-    return ret;
+/* Check whether the next request, or the next command of a batch, has been
+ * received completely.
+ */
+static bool request_ready(web_conn_t *c)
+{
+    if (!c->body_left)
+        return request_end(c);
+    size_t avail = c->len - c->start;
+    return !c->batch || avail >= c->body_left ||
+           memchr(c->buf + c->start, '\n', avail);
 }
 
-int web_eventmux(char *buf, size_t buflen)
+/* Read whatever is available on connection i.
+ * Return false if the connection was closed.
+ */
+static bool read_conn(int i)
 {
-    fd_set listenset;
-
-    FD_ZERO(&listenset);
-    FD_SET(STDIN_FILENO, &listenset);
-    int max_fd = STDIN_FILENO;
-    if (server_fd > 0) {
-        FD_SET(server_fd, &listenset);
-        max_fd = max_fd > server_fd ? max_fd : server_fd;
+    web_conn_t *c = conns[i];
+    for (;;) {
+        if (c->len == sizeof(c->buf)) {
+            /* Leave the rest in the socket until pipelined requests are
+             * served.  A single request this large is given up on.
+             */
+            if (request_ready(c))
+                return true;
+            if (!c->start) {
+                close_conn(i);
+                return false;
+            }
+            c->len -= c->start;
+            memmove(c->buf, c->buf + c->start, c->len);
+            c->start = 0;
+        }
+        ssize_t n = read(c->fd, c->buf + c->len, sizeof(c->buf) - c->len);
+        if (n > 0) {
+            c->len += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+        /* EOF or error.  Serve what was received before closing */
+        if (c->start == c->len) {
+            close_conn(i);
+            return false;
+        }
+        c->eof = true;
+        return true;
     }
-    int result = select(max_fd + 1, &listenset, NULL, NULL, NULL);
-    if (result < 0)
-        return -1;
+}
 
-    if (server_fd > 0 && FD_ISSET(server_fd, &listenset)) {
-        FD_CLR(server_fd, &listenset);
-        struct sockaddr_in clientaddr;
-        socklen_t clientlen = sizeof(clientaddr);
-        int web_connfd =
-            accept(server_fd, (struct sockaddr *) &clientaddr, &clientlen);
-
-        char *p = web_recv(web_connfd, &clientaddr);
-        char *buffer = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n\r\n";
-        web_send(web_connfd, buffer);
-        strncpy(buf, p, buflen);
-        buf[buflen] = '\0';
-        free(p);
-        close(web_connfd);
-        return strlen(buf);
+/* The socket inherits TCP_CORK from the listener; toggle it so that what was
+ * written goes out now instead of when the connection closes.
+ */
+static void push_output(web_conn_t *c)
+{
+    int off = 0, on = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+    setsockopt(c->fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+}
+
+/* Terminate the response on connection i.
+ * Return false if the connection was closed, or is closing.
+ */
+static bool end_response(int i)
+{
+    web_conn_t *c = conns[i];
+    c->batch = false;
+    flush_output(c, NULL, 0, true);
+    if (!c->keep_alive) {
+        close_conn(i);
+        return false;
+    }
+    push_output(c);
+    return true;
+}
+
+/* Complete the response to the command that was last handed out.  A batch
+ * keeps its response open until next_request runs out of commands.
+ */
+static void finish_response()
+{
+    web_conn_t *c = busy_conn;
+    busy_conn = NULL;
+    web_connfd = 0;
+    if (!c)
+        return;
+    if (c->batch) {
+        flush_output(c, NULL, 0, false);
+        return;
+    }
+
+    for (int i = 0; i < n_conns; i++) {
+        if (conns[i] == c) {
+            end_response(i);
+            break;
+        }
+    }
+}
+
+/* Take the next command from the body of the batch running on c into buf.
+ * Return its length, or 0 if no complete command is left.
+ */
+static size_t batch_next(web_conn_t *c, char *buf, size_t buflen)
+{
+    while (c->body_left) {
+        char *line = c->buf + c->start;
+        size_t avail = c->len - c->start;
+        if (avail > c->body_left)
+            avail = c->body_left;
+
+        size_t len, used;
+        char *nl = memchr(line, '\n', avail);
+        if (nl) {
+            len = nl - line;
+            used = len + 1;
+        } else if (avail == c->body_left || c->eof) {
+            /* Last line of the body, or all that will ever arrive */
+            len = used = avail;
+            c->body_left = used;
+        } else {
+            return 0;
+        }
+        c->start += used;
+        c->body_left -= used;
+        if (c->start == c->len)
+            c->start = c->len = 0;
+
+        if (len && line[len - 1] == '\r')
+            len--;
+        if (!len)
+            continue; /* Skip blank lines */
+        if (len > buflen)
+            len = buflen;
+        /* The line may be overwritten by the next read, so copy it now */
+        memcpy(buf, line, len);
+        buf[len] = '\0';
+        return len;
     }
+    return 0;
+}
+
+/* Hand out the next request pending on any connection as a command in buf.
+ * Return its length, or 0 if there is none.
+ */
+static int next_request(char *buf, size_t buflen)
+{
+    for (int k = 0; k < n_conns;) {
+        int i = (next_conn + k) % n_conns;
+        web_conn_t *c = conns[i];
 
-    FD_CLR(STDIN_FILENO, &listenset);
+        if (c->broken) {
+            drop_conn(i);
+            continue;
+        }
+        /* Leave clients that do not keep up with their responses */
+        if (c->closing || unsent(c) > UNSENT_LIMIT) {
+            k++;
+            continue;
+        }
+
+        if (c->batch) {
+            size_t len = batch_next(c, buf, buflen);
+            if (len) {
+                next_conn = i + 1;
+                busy_conn = c;
+                web_connfd = c->fd;
+                return len;
+            }
+            if (c->body_left && !c->eof) {
+                k++; /* Wait for the rest of the batch */
+                continue;
+            }
+            if (!end_response(i))
+                continue;
+        }
+
+        http_request_t req;
+        if (!parse_request(c, &req)) {
+            if (c->eof)
+                close_conn(i); /* Nothing more will arrive */
+            else
+                k++;
+            continue;
+        }
+
+        c->chunked = req.chunked;
+        c->keep_alive = req.keep_alive && !c->eof;
+        c->body_left = req.content_length;
+        c->batch = req.batch;
+        c->header =
+            c->chunked ? "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n"
+                         "Transfer-Encoding: chunked\r\n\r\n"
+                       : "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\n"
+                         "Connection: close\r\n\r\n";
+        if (c->batch)
+            continue; /* Start on the commands in the body */
+
+        next_conn = i + 1;
+        busy_conn = c;
+        web_connfd = c->fd;
+
+        /* Copy the command, changing '/' to ' ' */
+        size_t len = req.uri_len < buflen ? req.uri_len : buflen;
+        for (size_t j = 0; j < len; j++)
+            buf[j] = j && req.uri[j] == '/' ? ' ' : req.uri[j];
+        buf[len] = '\0';
+        return len;
+    }
     return 0;
 }
+
+/* Event loop for the console while the web server is running.
+ * Serves all client connections until either a request is ready to be
+ * executed as a command, which is returned in buf, or standard input becomes
+ * readable, in which case 0 is returned.
+ */
+int web_eventmux(char *buf, size_t buflen)
+{
+    /* Getting here means the previous command, if any, has completed */
+    finish_response();
+
+    for (;;) {
+        int len = next_request(buf, buflen);
+        if (len > 0)
+            return len;
+
+        if (n_conns + 2 > pfds_cap) {
+            int cap = (n_conns + 2) * 2;
+            struct pollfd *np = realloc(pfds, cap * sizeof(struct pollfd));
+            if (!np)
+                return -1;
+            pfds = np;
+            pfds_cap = cap;
+        }
+        int nfds = 0;
+        pfds[nfds++] = (struct pollfd){.fd = STDIN_FILENO, .events = POLLIN};
+        int server_idx = -1;
+        if (server_fd > 0) {
+            server_idx = nfds;
+            pfds[nfds++] = (struct pollfd){.fd = server_fd, .events = POLLIN};
+        }
+        int first_conn = nfds;
+        for (int i = 0; i < n_conns; i++) {
+            web_conn_t *c = conns[i];
+            /* Requests held back are not read until the output drains */
+            bool hold = c->eof || c->closing || unsent(c) > UNSENT_LIMIT;
+            short events = (hold ? 0 : POLLIN) | (unsent(c) ? POLLOUT : 0);
+            /* Negative descriptors are ignored by poll */
+            pfds[nfds++] =
+                (struct pollfd){.fd = events ? c->fd : -1, .events = events};
+        }
+
+        if (poll(pfds, nfds, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        /* Write to and read from clients, walking backwards as closed ones
+         * are replaced by the last connection.
+         */
+        for (int i = n_conns - 1; i >= 0; i--) {
+            web_conn_t *c = conns[i];
+            if (!pfds[first_conn + i].revents)
+                continue;
+            if (unsent(c)) {
+                send_unsent(c);
+                push_output(c);
+            }
+            if (c->broken || (c->closing && !unsent(c)))
+                drop_conn(i);
+            else if (pfds[first_conn + i].events & POLLIN &&
+                     pfds[first_conn + i].revents & ~POLLOUT)
+                read_conn(i);
+        }
+
+        if (server_idx >= 0 && pfds[server_idx].revents & POLLIN) {
+            for (;;) {
+                struct sockaddr_in clientaddr;
+                socklen_t clientlen = sizeof(clientaddr);
+                int connfd = accept(server_fd, (struct sockaddr *) &clientaddr,
+                                    &clientlen);
+                if (connfd < 0)
+                    break;
+                add_conn(connfd);
+            }
+        }
+
+        if (pfds[0].revents & POLLIN)
+            return 0;
+    }
+}
@@ -5,9 +5,9 @@
 
 int web_open(int port);
 
-char *web_recv(int fd, struct sockaddr_in *clientaddr);
+void web_send(int out_fd, const char *buf, size_t len);
 
-void web_send(int out_fd, char *buffer);
+void web_flush();
 
 int web_eventmux(char *buf, size_t buflen);
 